@@ -0,0 +1,57 @@
+/*
+ * allocators.c - The malloc packages built into the driver
+ *
+ * mm.c is linked under its own names. Each variant (impl_mm.c,
+ * expl_mm.c, ...) is compiled with -D flags that rename mm_init,
+ * mm_malloc, mm_free, mm_realloc, and team to <variant>_mm_init and
+ * so on (see VARIANTS in the Makefile), so they can all live in one
+ * driver and be picked at run time with mdriver -A.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mm.h"
+#include "allocators.h"
+
+#ifndef MM_CONCURRENT
+#define MM_CONCURRENT 0
+#endif
+
+/* Declare the renamed entry points of variant v */
+#define DECLARE_VARIANT(v) \
+    int v##_mm_init(void); \
+    void *v##_mm_malloc(size_t size); \
+    void v##_mm_free(void *ptr); \
+    void *v##_mm_realloc(void *ptr, size_t size)
+
+/* The allocator_t of variant v; none of them take a lock */
+#define VARIANT(v) \
+    {#v, v##_mm_init, v##_mm_malloc, v##_mm_free, v##_mm_realloc, 0}
+
+DECLARE_VARIANT(impl);
+DECLARE_VARIANT(expl);
+DECLARE_VARIANT(expl_rl);
+DECLARE_VARIANT(exli);
+DECLARE_VARIANT(exli_rl);
+
+allocator_t allocators[NUM_ALLOCATORS + 1] = {
+    {"mm", mm_init, mm_malloc, mm_free, mm_realloc, MM_CONCURRENT},
+    VARIANT(impl),
+    VARIANT(expl),
+    VARIANT(expl_rl),
+    VARIANT(exli),
+    VARIANT(exli_rl),
+    {NULL, NULL, NULL, NULL, NULL, 0}
+};
+
+/*
+ * find_allocator - Return the allocator with this name, or NULL
+ */
+allocator_t *find_allocator(char *name)
+{
+    allocator_t *a;
+
+    for (a = allocators; a->name != NULL; a++)
+	if (!strcmp(a->name, name))
+	    return a;
+    return NULL;
+}
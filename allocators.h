@@ -0,0 +1,21 @@
+/*
+ * Allocator table
+ */
+
+/* One malloc package the driver can evaluate */
+typedef struct {
+    char *name;                         /* name used with mdriver -A */
+    int (*init)(void);                  /* its mm_init... */
+    void *(*malloc)(size_t size);       /* ... mm_malloc */
+    void (*free)(void *ptr);            /* ... mm_free */
+    void *(*realloc)(void *ptr, size_t size); /* ... and mm_realloc */
+    int thread_safe;                    /* may several threads call it? */
+} allocator_t;
+
+/* All NUM_ALLOCATORS allocators built into the driver, followed by 
+   one with a NULL name. The first one is mm.c */
+#define NUM_ALLOCATORS 6
+extern allocator_t allocators[NUM_ALLOCATORS + 1];
+
+/* Return the allocator with this name, or NULL if there is none */
+allocator_t *find_allocator(char *name);
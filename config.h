@@ -62,11 +62,30 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Set USE_VM_HEAP to 1 (or build with "make VMHEAP=1") to model the 
+ * heap with a reserved range of virtual memory whose pages are 
+ * committed as the brk grows, instead of a malloc'd MAX_HEAP array.
+ * MAX_VM_HEAP is the size of that range.
+ */
+#ifndef USE_VM_HEAP
+#define USE_VM_HEAP 0
+#endif
+#define MAX_VM_HEAP (1UL<<36)  /* 64 GB */
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_MONO   1   /* CLOCK_MONOTONIC_RAW, median of runs (Linux) */
+
+/*
+ * USE_MONO times MONO_REPS runs one by one after MONO_WARMUP untimed
+ * runs, and reports the median. Override them with mdriver -W and -R.
+ */
+#define MONO_WARMUP 2
+#define MONO_REPS   15
 
 #endif /* __CONFIG_H */
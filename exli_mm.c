@@ -41,8 +41,8 @@ team_t team = {
 #define CHUNKSIZE (1<<CHUNKLEN)
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int *)(p) = (val))
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -78,8 +78,8 @@ int mm_init(void)
     // Prologue header
     PUT(heap_listp + (1 * WSIZE), PACK(2 * DSIZE, 1)); 
     // predecessor, successor
-    PUT(heap_listp + (2 * WSIZE), (unsigned int)NULL);
-    PUT(heap_listp + (3 * WSIZE), (unsigned int)NULL);
+    PUT(heap_listp + (2 * WSIZE), 0);
+    PUT(heap_listp + (3 * WSIZE), 0);
     // Prologue footer
     PUT(heap_listp + (4 * WSIZE), PACK(2 * DSIZE, 1)); 
     // epilogue header
@@ -231,16 +231,16 @@ static int get_list_index(size_t size) {
     return index;
 }
 
-static void *first_fit(size_t asize) {
-    void *bp = free_listp[get_list_index(asize)];
-    while (GET_ALLOC(HDRP(bp)) != 1) {
-        if(GET_SIZE(HDRP(bp)) >= asize){
-            return bp;
-        }
-        bp = SUCC(bp);
-    }
-    return NULL;
-}
+// static void *first_fit(size_t asize) {
+//     void *bp = free_listp[get_list_index(asize)];
+//     while (GET_ALLOC(HDRP(bp)) != 1) {
+//         if(GET_SIZE(HDRP(bp)) >= asize){
+//             return bp;
+//         }
+//         bp = SUCC(bp);
+//     }
+//     return NULL;
+// }
 
 static void *best_fit(size_t asize) {
     void *bp = free_listp[get_list_index(asize)];
@@ -43,8 +43,8 @@ team_t team = {
 #define CHUNKSIZE (1<<CHUNKLEN)
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int *)(p) = (val))
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -55,13 +55,29 @@ team_t team = {
 #define PRED(bp) (*(char **)(bp))
 #define SUCC(bp) (*(char **)(bp + WSIZE))
 
+// size class 구성
+// - MIN_BLOCK ~ SMALL_MAX 는 DSIZE 단위로 크기가 정확히 같은 블록만 모음
+// - SMALL_MAX 초과는 2의 거듭제곱 구간을 SUBCLASSES 개로 나눈 로그 간격 class
+// - 마지막 class 는 나머지 큰 블록을 모두 받는 catch-all
+#define MIN_BLOCK (2 * DSIZE)
+#define SMALL_LOG 9
+#define SMALL_MAX (1 << SMALL_LOG)
+#define SMALL_CLASSES ((SMALL_MAX - MIN_BLOCK) / DSIZE + 1)
+#define SUBCLASS_LOG 2
+#define NUM_CLASSES 64
+
 static char *heap_listp;
-static char *free_listp[CHUNKLEN + 1];
+static char *free_listp[NUM_CLASSES];
+// i 번째 bit 가 1 이면 free_listp[i] 가 비어있지 않음
+static unsigned long class_map;
 static void *extend_heap(size_t words);
 static void *coalesce(void *bp);
 static void *find_fit(size_t asize);
-static void *best_fit(size_t asize);
+static void *best_fit(int idx, size_t asize);
 static void place(void *bp, size_t asize);
+static size_t adjust_size(size_t size);
+static void *realloc_in_place(void *bp, size_t asize);
+static void split_block(void *bp, size_t asize);
 
 static void connect(void *bp);
 static void disconnect(void *bp);
@@ -80,17 +96,15 @@ int mm_init(void)
     // Prologue header
     PUT(heap_listp + (1 * WSIZE), PACK(2 * DSIZE, 1)); 
     // predecessor, successor
-    PUT(heap_listp + (2 * WSIZE), (unsigned int)NULL);
-    PUT(heap_listp + (3 * WSIZE), (unsigned int)NULL);
+    PUT(heap_listp + (2 * WSIZE), 0);
+    PUT(heap_listp + (3 * WSIZE), 0);
     // Prologue footer
     PUT(heap_listp + (4 * WSIZE), PACK(2 * DSIZE, 1)); 
     // epilogue header
     PUT(heap_listp + (5 * WSIZE), PACK(0, 1)); 
     // 힙 시작 위치
-    int i;
-    for(i = 0; i < CHUNKLEN + 1; i++) {
-        free_listp[i] = heap_listp + (2 * WSIZE);
-    }
+    memset(free_listp, 0, sizeof(free_listp));
+    class_map = 0;
     heap_listp += (2 * WSIZE);
 
     // extend the empty heap with a free block of CHUNKSIZE bytes
@@ -127,10 +141,7 @@ void *mm_malloc(size_t size)
     if (size <= 0) 
         return NULL;
 
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    asize = adjust_size(size);
     
     if ((bp = find_fit(asize)) != NULL) {
         place(bp, asize);
@@ -156,7 +167,8 @@ void mm_free(void *bp)
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mm_realloc - Resize in place when the neighbours allow it, otherwise
+ *     fall back to mm_malloc, copy and mm_free
  */
 void *mm_realloc(void *ptr, size_t size)
 {
@@ -170,23 +182,15 @@ void *mm_realloc(void *ptr, size_t size)
     }
 
     size_t old_size = GET_SIZE(HDRP(ptr));
-    size_t new_size = ALIGN(size + DSIZE);
-
-    // 요청된 크기가 기존 블록보다 크기가 작거나 같다면 기존 블록 사용
-    if (new_size <= old_size) {
-        return ptr;
-    }
+    size_t new_size = adjust_size(size);
+    void *newptr;
 
-    // 다음 블록 free, 병합해서 크기가 충분하면
-    if (!GET_ALLOC(HDRP(NEXT_BLKP(ptr))) && (old_size + GET_SIZE(HDRP(NEXT_BLKP(ptr))) >= new_size)) {
-        size_t combined_size = old_size + GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        disconnect(NEXT_BLKP(ptr));  // 가용 리스트에서 다음 블록을 제거
-        PUT(HDRP(ptr), PACK(combined_size, 1));
-        PUT(FTRP(ptr), PACK(combined_size, 1));
-        return ptr;
+    // 줄이거나, 주변 free 블록 / heap 끝을 이용해 복사 없이 늘릴 수 있으면 그대로 사용
+    if ((newptr = realloc_in_place(ptr, new_size)) != NULL) {
+        return newptr;
     }
 
-    void *newptr = mm_malloc(size);
+    newptr = mm_malloc(size);
     if (newptr == NULL) {
         return NULL;
     }
@@ -197,6 +201,82 @@ void *mm_realloc(void *ptr, size_t size)
     return newptr;
 }
 
+// header 와 footer, payload 를 담는 DSIZE 배수 크기
+static size_t adjust_size(size_t size)
+{
+    if (size <= DSIZE)
+        return 2 * DSIZE;
+    return DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+}
+
+// 새 블록을 받지 않고 제자리에서 (또는 앞 free 블록으로 당겨서) 크기를 맞춤, 안 되면 NULL
+static void *realloc_in_place(void *bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_size = GET_ALLOC(FTRP(PREV_BLKP(bp))) ? 0 : GET_SIZE(HDRP(PREV_BLKP(bp)));
+    char *next = NEXT_BLKP(bp);
+    size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    char *newbp;
+
+    // 줄어들면 남는 부분만 떼어서 돌려줌
+    if (asize <= size) {
+        split_block(bp, asize);
+        return bp;
+    }
+
+    // 다음 free 블록을 흡수
+    if (size + next_size >= asize) {
+        disconnect(next);
+        PUT(HDRP(bp), PACK(size + next_size, 1));
+        PUT(FTRP(bp), PACK(size + next_size, 1));
+        split_block(bp, asize);
+        return bp;
+    }
+
+    // heap 의 마지막 블록이면 (뒤의 free 블록을 포함해) 모자란 만큼만 heap 을 늘림
+    // 복사가 없으므로 앞 블록으로 옮기는 것보다 먼저 시도
+    if (GET_SIZE(HDRP(next_size ? NEXT_BLKP(next) : next)) == 0) {
+        if (mem_sbrk(asize - size - next_size) == (void *)-1)
+            return NULL;
+        if (next_size)
+            disconnect(next);
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+        return bp;
+    }
+
+    // 앞 free 블록까지 합쳐서 충분하면 payload 를 앞으로 옮김
+    if (prev_size + size + next_size >= asize) {
+        newbp = (char *)bp - prev_size;
+        disconnect(newbp);
+        if (next_size)
+            disconnect(next);
+        memmove(newbp, bp, size - DSIZE);
+        PUT(HDRP(newbp), PACK(prev_size + size + next_size, 1));
+        PUT(FTRP(newbp), PACK(prev_size + size + next_size, 1));
+        split_block(newbp, asize);
+        return newbp;
+    }
+    return NULL;
+}
+
+// allocated 블록을 asize 로 줄이고 남는 부분이 블록이 될 만큼 크면 free 로 돌려줌
+static void split_block(void *bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *rest;
+
+    if (size - asize < 2 * DSIZE)
+        return;
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(size - asize, 0));
+    PUT(FTRP(rest), PACK(size - asize, 0));
+    coalesce(rest);
+}
+
 static void *coalesce(void *bp) 
 {
     size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
@@ -239,32 +319,25 @@ static void *coalesce(void *bp)
     return bp;
 }
 
+// 작은 크기는 나눗셈 한 번, 큰 크기는 clz 로 구간을 바로 계산
 static int get_list_index(size_t size) {
-    int index = 0;
-    while (index < CHUNKLEN && size > 1) {
-        size >>= 1;
-        index++;
-    }
-    return index;
-}
+    int log, idx;
 
-static void *first_fit(size_t asize) {
-    void *bp = free_listp[get_list_index(asize)];
-    while (GET_ALLOC(HDRP(bp)) != 1) {
-        if(GET_SIZE(HDRP(bp)) >= asize){
-            return bp;
-        }
-        bp = SUCC(bp);
-    }
-    return NULL;
+    if (size <= SMALL_MAX)
+        return (size - MIN_BLOCK) / DSIZE;
+
+    log = 63 - __builtin_clzl(size);
+    idx = SMALL_CLASSES + ((log - SMALL_LOG) << SUBCLASS_LOG)
+        + ((size >> (log - SUBCLASS_LOG)) & ((1 << SUBCLASS_LOG) - 1));
+    return idx < NUM_CLASSES ? idx : NUM_CLASSES - 1;
 }
 
-static void *best_fit(size_t asize) {
-    void *bp = free_listp[get_list_index(asize)];
+static void *best_fit(int idx, size_t asize) {
+    void *bp = free_listp[idx];
     void *min_size_bp = NULL;
     size_t min_size = (size_t) - 1;
 
-    while (GET_ALLOC(HDRP(bp)) != 1) {
+    while (bp != NULL) {
         if (GET_SIZE(HDRP(bp)) == asize) {
             return bp;
         }
@@ -279,8 +352,29 @@ static void *best_fit(size_t asize) {
 }
 
 static void *find_fit(size_t asize) {
-    return best_fit(asize);
-    // return first_fit(asize);
+    int idx = get_list_index(asize);
+    unsigned long map;
+    void *bp;
+
+    // 작은 class 는 모든 블록 크기가 asize 와 같으므로 맨 앞 블록을 사용
+    if (idx < SMALL_CLASSES) {
+        if (free_listp[idx] != NULL)
+            return free_listp[idx];
+    } else if ((bp = best_fit(idx, asize)) != NULL) {
+        return bp;
+    }
+
+    // 더 큰 class 의 블록은 모두 asize 보다 크므로 bitmap 으로 첫 class 를 찾음
+    if (idx == NUM_CLASSES - 1)
+        return NULL;
+    map = class_map & (~0UL << (idx + 1));
+    if (map == 0)
+        return NULL;
+    idx = __builtin_ctzl(map);
+    // 작은 class 는 블록 크기가 모두 같으므로 훑을 필요 없이 맨 앞 블록이 best fit
+    if (idx < SMALL_CLASSES)
+        return free_listp[idx];
+    return best_fit(idx, asize);
 }
 
 static void place(void *bp, size_t asize) {
@@ -304,17 +398,20 @@ static void connect(void *bp) {
     int idx = get_list_index(GET_SIZE(HDRP(bp)));
     SUCC(bp) = free_listp[idx];
     PRED(bp) = NULL;
-    PRED(free_listp[idx]) = bp;
+    if (free_listp[idx] != NULL)
+        PRED(free_listp[idx]) = bp;
     free_listp[idx] = bp;
+    class_map |= 1UL << idx;
 }
 
 static void disconnect(void *bp) {
     int idx = get_list_index(GET_SIZE(HDRP(bp)));
-    if(bp == free_listp[idx]) {
-        PRED(SUCC(bp)) = NULL;
+    if (PRED(bp) != NULL)
+        SUCC(PRED(bp)) = SUCC(bp);
+    else
         free_listp[idx] = SUCC(bp);
-        return;
-    } 
-    SUCC(PRED(bp)) = SUCC(bp);
-    PRED(SUCC(bp)) = PRED(bp);
+    if (SUCC(bp) != NULL)
+        PRED(SUCC(bp)) = PRED(bp);
+    if (free_listp[idx] == NULL)
+        class_map &= ~(1UL << idx);
 }
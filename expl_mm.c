@@ -40,8 +40,8 @@ team_t team = {
 #define CHUNKSIZE (1<<9)
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int *)(p) = (val))
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -57,7 +57,7 @@ static char *free_listp;
 static void *extend_heap(size_t words);
 static void *coalesce(void *bp);
 static void *find_fit(size_t asize);
-static void *best_fit(size_t asize);
+// static void *best_fit(size_t asize);
 static void place(void *bp, size_t asize);
 
 static void connect(void *bp);
@@ -77,8 +77,8 @@ int mm_init(void)
     // Prologue header
     PUT(heap_listp + (1 * WSIZE), PACK(2 * DSIZE, 1)); 
     // predecessor, successor
-    PUT(heap_listp + (2 * WSIZE), (unsigned int)NULL);
-    PUT(heap_listp + (3 * WSIZE), (unsigned int)NULL);
+    PUT(heap_listp + (2 * WSIZE), 0);
+    PUT(heap_listp + (3 * WSIZE), 0);
     // Prologue footer
     PUT(heap_listp + (4 * WSIZE), PACK(2 * DSIZE, 1)); 
     // epilogue header
@@ -229,24 +229,24 @@ static void *first_fit(size_t asize) {
     return NULL;
 }
 
-static void *best_fit(size_t asize) {
-    void *bp = free_listp;
-    void *min_size_bp = NULL;
-    size_t min_size = (size_t) - 1;
-
-    while (GET_ALLOC(HDRP(bp)) != 1) {
-        if (GET_SIZE(HDRP(bp)) == asize) {
-            return bp;
-        }
-        if (GET_SIZE(HDRP(bp)) > asize && GET_SIZE(HDRP(bp)) < min_size) {
-            min_size = GET_SIZE(HDRP(bp));
-            min_size_bp = bp;
-        }
-        bp = SUCC(bp);
-    }
+// static void *best_fit(size_t asize) {
+//     void *bp = free_listp;
+//     void *min_size_bp = NULL;
+//     size_t min_size = (size_t) - 1;
     
-    return min_size_bp;
-}
+//     while (GET_ALLOC(HDRP(bp)) != 1) {
+//         if (GET_SIZE(HDRP(bp)) == asize) {
+//             return bp;
+//         }
+//         if (GET_SIZE(HDRP(bp)) > asize && GET_SIZE(HDRP(bp)) < min_size) {
+//             min_size = GET_SIZE(HDRP(bp));
+//             min_size_bp = bp;
+//         }
+//         bp = SUCC(bp);
+//     }
+//     
+//     return min_size_bp;
+// }
 
 static void *find_fit(size_t asize) {
     // return best_fit(asize);
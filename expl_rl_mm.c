@@ -42,8 +42,8 @@ team_t team = {
 #define CHUNKSIZE (1<<5)
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int *)(p) = (val))
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -79,8 +79,8 @@ int mm_init(void)
     // Prologue header
     PUT(heap_listp + (1 * WSIZE), PACK(2 * DSIZE, 1)); 
     // predecessor, successor
-    PUT(heap_listp + (2 * WSIZE), (unsigned int)NULL);
-    PUT(heap_listp + (3 * WSIZE), (unsigned int)NULL);
+    PUT(heap_listp + (2 * WSIZE), 0);
+    PUT(heap_listp + (3 * WSIZE), 0);
     // Prologue footer
     PUT(heap_listp + (4 * WSIZE), PACK(2 * DSIZE, 1)); 
     // epilogue header
@@ -117,7 +117,7 @@ static void *extend_heap(size_t words)
 void *mm_malloc(size_t size)
 {
     size_t asize;
-    size_t extendsize;
+    // size_t extendsize;
     char *bp;
 
     if (size <= 0) 
@@ -231,16 +231,16 @@ static void *coalesce(void *bp)
     return bp;
 }
 
-static void *first_fit(size_t asize) {
-    void *bp = free_listp;
-    while (GET_ALLOC(HDRP(bp)) != 1) {
-        if(GET_SIZE(HDRP(bp)) >= asize){
-            return bp;
-        }
-        bp = SUCC(bp);
-    }
-    return NULL;
-}
+// static void *first_fit(size_t asize) {
+//     void *bp = free_listp;
+//     while (GET_ALLOC(HDRP(bp)) != 1) {
+//         if(GET_SIZE(HDRP(bp)) >= asize){
+//             return bp;
+//         }
+//         bp = SUCC(bp);
+//     }
+//     return NULL;
+// }
 
 static void *best_fit(size_t asize) {
     void *bp = free_listp;
@@ -2,6 +2,8 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -12,6 +14,20 @@ static double Mhz;  /* estimated CPU clock frequency */
 
 extern int verbose; /* -v option in mdriver.c */
 
+#if USE_MONO
+static int warmup = MONO_WARMUP; /* untimed runs before the timed ones */
+static int reps = MONO_REPS;     /* number of timed runs */
+static double last_min;          /* fastest run behind the last result */
+static double last_ci;           /* relative half-width of its 95% CI */
+
+/* compare two doubles for qsort */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+#endif
+
 /*
  * init_fsecs - initialize the timing package
  */
@@ -36,6 +52,21 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_MONO
+    if (verbose)
+	printf("Measuring performance with CLOCK_MONOTONIC_RAW "
+	       "(median of %d runs after %d warm-up runs).\n", reps, warmup);
+#endif
+}
+
+/*
+ * set_fsecs_runs - set the number of untimed and timed runs of USE_MONO
+ */
+void set_fsecs_runs(int w, int r)
+{
+#if USE_MONO
+    warmup = w;
+    reps = r;
 #endif
 }
 
@@ -51,7 +82,46 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_MONO
+    double *secs, median;
+    int lo, hi;
+
+    if ((secs = malloc(reps * sizeof(double))) == NULL) {
+	fprintf(stderr, "fsecs: out of memory\n");
+	exit(1);
+    }
+    ftimer_mono(f, argp, warmup, reps, secs);
+    qsort(secs, reps, sizeof(double), cmp_double);
+
+    median = (reps % 2) ? secs[reps/2] : (secs[reps/2-1] + secs[reps/2]) / 2;
+    last_min = secs[0];
+
+    /* The order statistics that bound a distribution-free 95% CI of 
+       the median (ranks n/2 -/+ 1.96*sqrt(n)/2, made 0-based) */
+    lo = (int)floor(reps/2.0 - 0.98*sqrt(reps)) - 1;
+    hi = (int)ceil(reps/2.0 + 0.98*sqrt(reps));
+    if (lo < 0)
+	lo = 0;
+    if (hi > reps - 1)
+	hi = reps - 1;
+    last_ci = (secs[hi] - secs[lo]) / 2 / median;
+
+    free(secs);
+    return median;
 #endif 
 }
 
-
+/*
+ * fsecs_spread - Fastest run and relative half-width of the 95% CI
+ *     behind the last fsecs result. Return 0 if they are not known.
+ */
+int fsecs_spread(double *min, double *ci)
+{
+#if USE_MONO
+    *min = last_min;
+    *ci = last_ci;
+    return 1;
+#else
+    return 0;
+#endif
+}
@@ -2,3 +2,11 @@ typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* Set the number of untimed and timed runs of USE_MONO */
+void set_fsecs_runs(int warmup, int reps);
+
+/* Fastest run and relative half-width of the 95% confidence interval 
+   of the median behind the last fsecs result. Return 0 if the timing
+   method does not report them */
+int fsecs_spread(double *min, double *ci);
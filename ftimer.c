@@ -7,8 +7,10 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_mono: version that uses clock_gettime(CLOCK_MONOTONIC_RAW)
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
@@ -52,6 +54,27 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/*
+ * ftimer_mono - Use the raw monotonic clock, which NTP does not slew,
+ * to time each of n runs of f(argp) separately, after warmup runs
+ * that are not timed. Store the secs of run i in secs[i].
+ */
+void ftimer_mono(ftimer_test_funct f, void *argp, int warmup, int n, 
+		 double *secs)
+{
+    int i;
+    struct timespec sts, ets;
+
+    for (i = 0; i < warmup; i++)
+	f(argp);
+    for (i = 0; i < n; i++) {
+	clock_gettime(CLOCK_MONOTONIC_RAW, &sts);
+	f(argp);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ets);
+	secs[i] = (ets.tv_sec - sts.tv_sec) + 1E-9*(ets.tv_nsec - sts.tv_nsec);
+    }
+}
+
 
 /*
  * Routines for manipulating the Unix interval timer
@@ -12,3 +12,8 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Time n runs of f(argp) one by one with CLOCK_MONOTONIC_RAW, after
+   warmup untimed runs. Store the secs of run i in secs[i] */
+void ftimer_mono(ftimer_test_funct f, void *argp, int warmup, int n, 
+		 double *secs);
+
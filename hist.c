@@ -0,0 +1,78 @@
+/*
+ * hist.c - Log-bucket histograms of operation latencies
+ *
+ * Adding a value costs a count-leading-zeros and an increment, so
+ * every op of a trace can be recorded without disturbing its timing
+ * much. Quantiles are read back as the upper edge of the bucket that
+ * holds them, which overstates them by at most 1/HIST_SUB.
+ */
+#include <string.h>
+#include "hist.h"
+
+/*
+ * bucket - index of the bucket that holds value v
+ */
+static int bucket(unsigned long v)
+{
+    int m;
+
+    if (v < 2 * HIST_SUB)
+	return (int)v;
+    m = 63 - __builtin_clzl(v);     /* position of the top bit */
+    return (m - HIST_SUB_BITS + 1) * HIST_SUB +
+	(int)((v >> (m - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/*
+ * bucket_max - largest value that falls in bucket i
+ */
+static unsigned long bucket_max(int i)
+{
+    int m, sub;
+
+    if (i < 2 * HIST_SUB)
+	return (unsigned long)i;
+    m = i / HIST_SUB + HIST_SUB_BITS - 1;
+    sub = i % HIST_SUB;
+    return ((unsigned long)(HIST_SUB + sub + 1) << (m - HIST_SUB_BITS)) - 1;
+}
+
+/*
+ * hist_reset - empty the histogram
+ */
+void hist_reset(hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * hist_add - add value v to the histogram
+ */
+void hist_add(hist_t *h, unsigned long v)
+{
+    h->count[bucket(v)]++;
+    h->n++;
+    if (v > h->max)
+	h->max = v;
+}
+
+/*
+ * hist_quantile - upper bound of the q-quantile, capped at the max
+ */
+unsigned long hist_quantile(hist_t *h, double q)
+{
+    unsigned long rank, seen = 0;
+    int i;
+
+    if (h->n == 0)
+	return 0;
+    rank = (unsigned long)(q * h->n);
+    if (rank >= h->n)
+	rank = h->n - 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->count[i];
+	if (seen > rank)
+	    return bucket_max(i) < h->max ? bucket_max(i) : h->max;
+    }
+    return h->max;
+}
@@ -0,0 +1,26 @@
+/*
+ * Log-bucket latency histograms
+ */
+
+/* Values below 2^(HIST_SUB_BITS+1) get a bucket each; every power of
+   two above that is split into 2^HIST_SUB_BITS buckets, so a bucket is
+   at most 1/8 wider than the values in it */
+#define HIST_SUB_BITS 3
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    unsigned long n;                     /* number of values */
+    unsigned long max;                   /* largest value */
+    unsigned long count[HIST_BUCKETS];   /* number of values in each bucket */
+} hist_t;
+
+/* Empty the histogram */
+void hist_reset(hist_t *h);
+
+/* Add value v to the histogram */
+void hist_add(hist_t *h, unsigned long v);
+
+/* Return an upper bound of the q-quantile (0 <= q <= 1), which is
+   never more than the largest value */
+unsigned long hist_quantile(hist_t *h, double q);
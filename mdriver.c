@@ -12,14 +12,27 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
+#include "hist.h"
+#include "allocators.h"
+#include "mmgen.h"
+#include "tstream.h"
+#include "ztrace.h"
 #include "config.h"
+#include "trace.h"
 
 /**********************
  * Constants and macros
@@ -29,27 +42,51 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define NUM_OPTYPES    3 /* ALLOC, FREE, and REALLOC */
+#define GEN_CHUNK  65536 /* generated ops replayed at a time (-G) */
+
+/* Multi-threaded replay modes (-m) */
+#define MT_COPY  0 /* every thread replays its own copy of the trace */
+#define MT_SPLIT 1 /* ids are partitioned across threads */
+#define MT_XFREE 2 /* like MT_SPLIT, but the next thread frees each block */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* 
+ * Records the extent of each block's payload. The ranges form a treap
+ * (a BST ordered by lo that is also a max-heap on prio), so lookups,
+ * inserts and removals take expected O(log n) time.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned prio;         /* random heap priority */
+    struct range_t *left;  /* ranges with smaller lo */
+    struct range_t *right; /* ranges with larger lo */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/*
+ * Maps the id of each live block of a streamed trace (-S) to its
+ * payload. The table is open-addressed and at most half full, and
+ * the slots of freed blocks are emptied, so its size follows the live
+ * set rather than the number of ids in the trace.
+ */
+typedef struct {
+    int id;          /* block id, or -1 if the slot is empty */
+    int size;        /* payload size in bytes */
+    char *p;         /* payload address */
+} idslot_t;
+
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+    idslot_t *slots;
+    int bits;        /* there are 1 << bits slots... */
+    int count;       /* ... and count of them are in use */
+} idmap_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
@@ -60,6 +97,8 @@ typedef struct {
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping that holds ops for binary traces... */
+    size_t map_len;      /* ... and its length in bytes (0 for text traces) */
 } trace_t;
 
 /* 
@@ -78,18 +117,59 @@ typedef struct {
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double min_secs; /* secs of the fastest run (USE_MONO only)... */
+    double ci;       /* ... and relative half-width of the 95% CI of secs */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double heap;     /* peak heap size in bytes, mappings included... */
+    double live;     /* ... and peak number of payload bytes in use */
 
-    /* Note: secs and util are only defined if valid is true */
+    /* hardware counters of one extra run of the trace (-P) */
+    perfctr_t ctr;
+
+    /* latency in ns of each op type in one extra run of the trace (-L) */
+    hist_t lat[NUM_OPTYPES];
+
+    /* Note: secs, util, ctr, and lat are only defined if valid is true */
 } stats_t; 
 
+/* Summarizes a multi-threaded replay of one trace (-T) */
+typedef struct {
+    int valid;       /* was the trace replayed on multiple threads? */
+    double ops;      /* number of ops over all threads */
+    double secs;     /* wall clock secs until the last thread finished */
+    double *tops;    /* number of ops done by each thread... */
+    double *tsecs;   /* ... and the secs each thread needed to do them */
+} mt_stats_t;
+
+/* Holds the params of one thread in a multi-threaded replay */
+typedef struct {
+    trace_t *trace;
+    int num_ops;                /* number of ops for this thread... */
+    int *opidx;                 /* ... and their indices (NULL: all ops) */
+    char **blocks;              /* block pointers, shared unless MT_COPY */
+    int *ready;                 /* MT_XFREE: allocs+reallocs done per id, */
+    int *freed;                 /* frees done per id, */
+    int *need;                  /* and how many of them each op waits for */
+    pthread_barrier_t *barrier; /* released when all threads are ready */
+    int *failed;                /* set when any thread gets a NULL block */
+    double start;               /* CLOCK_MONOTONIC secs when the thread... */
+    double end;                 /* ... started and finished its ops */
+} mt_arg_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int perf = 0;    /* if set, count hardware events per trace (-P) */
+static int latency = 0; /* if set, time each op of each trace (-L) */
+static int spread = 0;  /* set if fsecs reports min secs and CI */
+static FILE *out = NULL;  /* machine-readable results (-o)... */
+static int out_json = 0;  /* ... in JSON if set, else in CSV */
+static int out_count = 0; /* number of records written to out */
+static allocator_t *alloc; /* the malloc package under test */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -105,14 +185,28 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *find_range(range_t *ranges, char *addr);
+static range_t *insert_range(range_t *root, range_t *p);
+static range_t *delete_range(range_t *root, char *lo);
+
+/* these functions map the live ids of a streamed trace to their blocks */
+static void idmap_init(idmap_t *map, int bits);
+static idslot_t *idmap_find(idmap_t *map, int id);
+static idslot_t *idmap_add(idmap_t *map, int id);
+static void idmap_remove(idmap_t *map, idslot_t *slot);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static void read_btrace(trace_t *trace, int fd, char *path);
+static void check_ops(trace_t *trace, char *path);
+static void write_btrace(trace_t *trace, char *path);
+static void read_ztrace(trace_t *trace, int fd, char *path);
+static long long write_ztrace(char *inpath, char *outpath);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
@@ -122,11 +216,32 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *heap, double *live);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, hist_t *lat);
+static void eval_mm_gen(char *spec, stats_t *stats);
+static void eval_mm_stream(char *path, stats_t *stats);
+
+/* Routines for replaying a trace on several threads at once */
+static void eval_mm_threads(trace_t *trace, int tracenum, int nthreads, 
+			    int mode, mt_stats_t *stats);
+static void *mt_replay(void *ptr);
 
 /* Various helper routines */
+static unsigned long now_ns(void);
 static void printresults(int n, stats_t *stats);
+static void printcounters(perfctr_t *ctr, double ops);
+static void printlatency(int n, stats_t *stats);
+static void printmtresults(int n, int nthreads, mt_stats_t *stats);
+static void open_output(char *path);
+static void write_output(char *name, char **tracefiles, int n, 
+			 stats_t *stats, int space);
+static void write_string(char *str);
+static void close_output(int m, allocator_t **allocs, double *perfidx);
+static void printcompare(int n, int m, allocator_t **allocs, 
+			 stats_t **stats, double *perfidx);
+static int select_allocators(char *list, allocator_t **allocs);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -145,11 +260,26 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t **all_stats = NULL;/* ... and those of each package under test */
+    double *all_perfidx = NULL;/* perf index of each package under test */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    char *btrace_out = NULL; /* If set, convert the -f trace to binary (-w) */
+    char *ztrace_out = NULL; /* If set, compress the -f trace (-z) */
+    char *results_out = NULL; /* If set, also write results to this file (-o) */
+    char *gen_spec = NULL; /* If set, replay this generated workload (-G) */
+    char *stream_path = NULL; /* If set, stream this trace as it is read (-S) */
+    int nthreads = 0;    /* If set, also replay on this many threads (-T) */
+    int mt_mode = MT_SPLIT; /* How traces are spread over threads (-m) */
+    int warmup = MONO_WARMUP; /* untimed runs before timing a trace (-W) */
+    int reps = MONO_REPS;   /* timed runs of each trace (-R) */
+    mt_stats_t *mt_stats = NULL; /* multi-threaded stats for each trace */
+    allocator_t *allocs[NUM_ALLOCATORS]; /* packages to evaluate (-A)... */
+    int num_allocs = 0;  /* ... and their number */
+    int a;
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +288,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:w:z:o:A:G:S:T:m:W:R:hvVgalPL")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,12 +308,74 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'w': /* Write the -f trace in binary format and exit */
+	    btrace_out = strdup(optarg);
+	    break;
+	case 'z': /* Write the -f trace in compressed format and exit */
+	    ztrace_out = strdup(optarg);
+	    break;
+	case 'o': /* Also write the results to a .json or .csv file */
+	    results_out = strdup(optarg);
+	    break;
+	case 'A': /* Evaluate these packages instead of mm.c alone */
+	    if ((num_allocs = select_allocators(optarg, allocs)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'G': /* Replay a generated workload instead of trace files */
+	    gen_spec = strdup(optarg);
+	    break;
+	case 'S': /* Stream one trace instead of loading it */
+	    stream_path = strdup(optarg);
+	    break;
+	case 'T': /* Also replay each trace on this many threads */
+	    nthreads = atoi(optarg);
+	    if (nthreads < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'm': /* Multi-threaded replay mode */
+	    if (!strcmp(optarg, "copy"))
+		mt_mode = MT_COPY;
+	    else if (!strcmp(optarg, "split"))
+		mt_mode = MT_SPLIT;
+	    else if (!strcmp(optarg, "xfree"))
+		mt_mode = MT_XFREE;
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'W': /* Untimed warm-up runs of each trace */
+	    warmup = atoi(optarg);
+	    if (warmup < 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'R': /* Timed runs of each trace */
+	    reps = atoi(optarg);
+	    if (reps < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'P': /* Count hardware events for each trace (implies -v) */
+            perf = 1;
+            if (!verbose)
+                verbose = 1;
+            break;
+        case 'L': /* Print per-op latency percentiles for each trace */
+            latency = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -199,6 +391,32 @@ int main(int argc, char **argv)
         }
     }
 	
+    /*
+     * Convert a trace to the binary format and quit, if asked to
+     */
+    if (btrace_out != NULL) {
+	if (tracefiles == NULL)
+	    app_error("The -w option requires a trace given with -f");
+	trace = read_trace(tracedir, tracefiles[0]);
+	write_btrace(trace, btrace_out);
+	printf("Wrote %d ops to %s\n", trace->num_ops, btrace_out);
+	free_trace(trace);
+	exit(0);
+    }
+
+    /*
+     * Or compress it, streaming it through so that it never has to
+     * fit in memory
+     */
+    if (ztrace_out != NULL) {
+	if (tracefiles == NULL)
+	    app_error("The -z option requires a trace given with -f");
+	sprintf(msg, "%s%s", tracedir, tracefiles[0]);
+	printf("Wrote %lld ops to %s\n", write_ztrace(msg, ztrace_out), 
+	       ztrace_out);
+	exit(0);
+    }
+
     /* 
      * Check and print team info 
      */
@@ -225,6 +443,20 @@ int main(int argc, char **argv)
 	    printf("Member 2 :%s:%s\n", team.name2, team.id2);
     }
 
+    /*
+     * A generated workload or a streamed trace takes the place of the 
+     * trace files. Neither is ever in memory as a whole, so only the 
+     * basic results are known.
+     */
+    if (gen_spec != NULL || stream_path != NULL) {
+	if (gen_spec != NULL && stream_path != NULL)
+	    app_error("The -G and -S options cannot be combined");
+	if (run_libc || nthreads > 0 || latency || perf)
+	    app_error("The -G and -S options cannot be combined with -l, -L, -P, or -T");
+	tracefiles = (gen_spec != NULL) ? &gen_spec : &stream_path;
+	num_tracefiles = 1;
+    }
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -235,8 +467,31 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
-    /* Initialize the timing package */
-    init_fsecs();
+    /* Without -A, evaluate mm.c only */
+    if (num_allocs == 0) {
+	allocs[0] = find_allocator("mm");
+	num_allocs = 1;
+    }
+
+    /* Open the results file early, so a bad name fails before any runs */
+    if (results_out != NULL)
+	open_output(results_out);
+
+    /* Initialize the timing package. A generated workload or a streamed
+       trace is replayed once, timing only the calls to the package */
+    if (gen_spec != NULL || stream_path != NULL) {
+	if (verbose)
+	    printf("Measuring performance with CLOCK_MONOTONIC_RAW "
+		   "(one timed pass, no warm-up runs).\n");
+    }
+    else {
+	set_fsecs_runs(warmup, reps);
+	init_fsecs();
+    }
+
+    /* Open the hardware counters; without any, quietly drop the columns */
+    if (perf && perfctr_init() == 0)
+	perf = 0;
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -262,6 +517,12 @@ int main(int argc, char **argv)
 		if (verbose > 1)
 		    printf("and performance.\n");
 		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+		spread = fsecs_spread(&libc_stats[i].min_secs, &libc_stats[i].ci);
+		if (perf) {
+		    perfctr_start();
+		    eval_libc_speed(&speed_params);
+		    perfctr_stop(&libc_stats[i].ctr);
+		}
 	    }
 	    free_trace(trace);
 	}
@@ -271,116 +532,195 @@ int main(int argc, char **argv)
 	    printf("\nResults for libc malloc:\n");
 	    printresults(num_tracefiles, libc_stats);
 	}
+	if (out != NULL)
+	    write_output("libc", tracefiles, num_tracefiles, libc_stats, 0);
     }
 
     /*
-     * Always run and evaluate the student's mm package
+     * Always run and evaluate the student's mm package, or each of the
+     * packages picked with -A
      */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
+    all_stats = (stats_t **)calloc(num_allocs, sizeof(stats_t *));
+    all_perfidx = (double *)calloc(num_allocs, sizeof(double));
+    if (all_stats == NULL || all_perfidx == NULL)
+	unix_error("all_stats calloc in main failed");
 
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-	unix_error("mm_stats calloc in main failed");
-    
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+    for (a = 0; a < num_allocs; a++) {
+	alloc = allocs[a];
+	errors = 0;
 	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    printf("\nTesting %s malloc\n", alloc->name);
+
+	/* Allocate its stats array, with one stats_t struct per tracefile */
+	mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (mm_stats == NULL)
+	    unix_error("mm_stats calloc in main failed");
+	if (nthreads > 0) {
+	    mt_stats = (mt_stats_t *)calloc(num_tracefiles, sizeof(mt_stats_t));
+	    if (mt_stats == NULL)
+		unix_error("mt_stats calloc in main failed");
+	}
+    
+	/* Replay the generated workload or the streamed trace, or 
+	   evaluate the malloc package on each trace using the K-best 
+	   scheme */
+	if (gen_spec != NULL)
+	    eval_mm_gen(gen_spec, &mm_stats[0]);
+	else if (stream_path != NULL)
+	    eval_mm_stream(stream_path, &mm_stats[0]);
+	else {
+	    for (i=0; i < num_tracefiles; i++) {
+		trace = read_trace(tracedir, tracefiles[i]);
+		mm_stats[i].ops = trace->num_ops;
+		if (verbose > 1)
+		    printf("Checking mm_malloc for correctness, ");
+		mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+		if (mm_stats[i].valid) {
+		    if (verbose > 1)
+			printf("efficiency, ");
+		    mm_stats[i].util = eval_mm_util(trace, i, &ranges, 
+						    &mm_stats[i].heap, &mm_stats[i].live);
+		    speed_params.trace = trace;
+		    speed_params.ranges = ranges;
+		    if (verbose > 1)
+			printf("and performance.\n");
+		    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+		    spread = fsecs_spread(&mm_stats[i].min_secs, &mm_stats[i].ci);
+		    if (perf) {
+			perfctr_start();
+			eval_mm_speed(&speed_params);
+			perfctr_stop(&mm_stats[i].ctr);
+		    }
+		    if (latency)
+			eval_mm_latency(trace, mm_stats[i].lat);
+		    if (nthreads > 0 && alloc->thread_safe) {
+			if (verbose > 1)
+			    printf("Replaying on %d threads.\n", nthreads);
+			eval_mm_threads(trace, i, nthreads, mt_mode, &mt_stats[i]);
+		    }
+		}
+		free_trace(trace);
+	    }
 	}
-	free_trace(trace);
-    }
-
-    /* Display the mm results in a compact table */
-    if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
-	printf("\n");
-    }
-
-    /* 
-     * Accumulate the aggregate statistics for the student's mm package 
-     */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
-	if (mm_stats[i].valid)
-	    numcorrect++;
-    }
-    avg_mm_util = util/num_tracefiles;
 
-    /* 
-     * Compute and print the performance index 
-     */
-    if (errors == 0) {
-	avg_mm_throughput = ops/secs;
+	/* Display the results in a compact table */
+	if (verbose) {
+	    printf("\nResults for %s malloc:\n", alloc->name);
+	    printresults(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
+	if (out != NULL)
+	    write_output(alloc->name, tracefiles, num_tracefiles, mm_stats, 1);
+
+	/* Display the latency percentiles, which were asked for explicitly */
+	if (latency) {
+	    printf("Latency of %s malloc ops in ns:\n", alloc->name);
+	    printlatency(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
 
-	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-	    p2 = (double)(1.0 - UTIL_WEIGHT);
-	} 
-	else {
-	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+	/* Display the multi-threaded results, which were asked for explicitly */
+	if (nthreads > 0 && alloc->thread_safe) {
+	    printf("Results for %s malloc on %d threads (%s):\n", 
+		   alloc->name, nthreads,
+		   mt_mode == MT_COPY ? "copy" : 
+		   mt_mode == MT_SPLIT ? "split" : "xfree");
+	    printmtresults(num_tracefiles, nthreads, mt_stats);
+	    printf("\n");
+	}
+	else if (nthreads > 0)
+	    printf("Skipped the %d-thread replay: %s malloc is not thread-safe\n\n",
+		   nthreads, alloc->name);
+
+	/* 
+	 * Accumulate the aggregate statistics for this malloc package 
+	 */
+	secs = 0;
+	ops = 0;
+	util = 0;
+	numcorrect = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    secs += mm_stats[i].secs;
+	    ops += mm_stats[i].ops;
+	    util += mm_stats[i].util;
+	    if (mm_stats[i].valid)
+		numcorrect++;
 	}
+	avg_mm_util = util/num_tracefiles;
+
+	/* 
+	 * Compute and print the performance index 
+	 */
+	if (errors == 0) {
+	    avg_mm_throughput = ops/secs;
+
+	    p1 = UTIL_WEIGHT * avg_mm_util;
+	    if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+		p2 = (double)(1.0 - UTIL_WEIGHT);
+	    } 
+	    else {
+		p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
+		    (avg_mm_throughput/AVG_LIBC_THRUPUT);
+	    }
 	
-	perfindex = (p1 + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
-	       p1*100, 
-	       p2*100, 
-	       perfindex);
+	    perfindex = (p1 + p2)*100.0;
+	    if (num_allocs > 1)
+		printf("%s: ", alloc->name);
+	    printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+		   p1*100, 
+		   p2*100, 
+		   perfindex);
 	
-    }
-    else { /* There were errors */
-	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
-    }
+	}
+	else { /* There were errors */
+	    perfindex = 0.0;
+	    if (num_allocs > 1)
+		printf("%s: ", alloc->name);
+	    printf("Terminated with %d errors\n", errors);
+	}
+
+	all_stats[a] = mm_stats;
+	all_perfidx[a] = perfindex;
+	if (num_allocs > 1)
+	    printf("\n");
 
-    if (autograder) {
-	printf("correct:%d\n", numcorrect);
-	printf("perfidx:%.0f\n", perfindex);
+	if (autograder && a == 0) {
+	    printf("correct:%d\n", numcorrect);
+	    printf("perfidx:%.0f\n", perfindex);
+	}
     }
 
+    /* Compare the packages side by side */
+    if (num_allocs > 1)
+	printcompare(num_tracefiles, num_allocs, allocs, all_stats, all_perfidx);
+
+    if (out != NULL)
+	close_output(num_allocs, allocs, all_perfidx);
+    if (perf)
+	perfctr_deinit();
     exit(0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
+    static unsigned seed = 1;
     char *hi = lo + size - 1;
     range_t *p;
     char msg[MAXLINE];
@@ -395,36 +735,45 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* 
+     * The payload must lie within the extent of the heap, or within
+     * one of the mappings the allocator got from mem_map
+     */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. Since the ranges
+     * in the tree are disjoint, the only candidate is the range with the
+     * largest lo that is still <= hi.
+     */
+    if ((p = find_range(*ranges, hi)) != NULL && p->hi >= lo) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    seed ^= seed << 13;  /* xorshift32 */
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->prio = seed;
+    p->left = p->right = NULL;
+    *ranges = insert_range(*ranges, p);
     return 1;
 }
 
@@ -433,19 +782,7 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    *ranges = delete_range(*ranges, lo);
 }
 
 /*
@@ -453,23 +790,207 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
     *ranges = NULL;
 }
 
+/*
+ * find_range - Return the range with the largest lo <= addr, or NULL
+ */
+static range_t *find_range(range_t *ranges, char *addr)
+{
+    range_t *p, *best = NULL;
+
+    for (p = ranges;  p != NULL; ) {
+	if (p->lo <= addr) {
+	    best = p;
+	    p = p->right;
+	}
+	else
+	    p = p->left;
+    }
+    return best;
+}
+
+/*
+ * insert_range - Insert p into the treap rooted at root and return 
+ *     the new root. Rotations restore the heap order on the way up.
+ */
+static range_t *insert_range(range_t *root, range_t *p)
+{
+    range_t *q;
+
+    if (root == NULL)
+	return p;
+
+    if (p->lo < root->lo) {
+	root->left = insert_range(root->left, p);
+	if (root->left->prio > root->prio) {
+	    q = root->left;               /* rotate right */
+	    root->left = q->right;
+	    q->right = root;
+	    root = q;
+	}
+    }
+    else {
+	root->right = insert_range(root->right, p);
+	if (root->right->prio > root->prio) {
+	    q = root->right;              /* rotate left */
+	    root->right = q->left;
+	    q->left = root;
+	    root = q;
+	}
+    }
+    return root;
+}
+
+/*
+ * delete_range - Remove and free the range starting at lo (if any) from
+ *     the treap rooted at root and return the new root.
+ */
+static range_t *delete_range(range_t *root, char *lo)
+{
+    range_t *q;
+
+    if (root == NULL)
+	return NULL;
+
+    if (lo < root->lo)
+	root->left = delete_range(root->left, lo);
+    else if (lo > root->lo)
+	root->right = delete_range(root->right, lo);
+    else if (root->left == NULL || root->right == NULL) {
+	q = (root->left != NULL) ? root->left : root->right;
+	free(root);
+	return q;
+    }
+    else if (root->left->prio > root->right->prio) {
+	q = root->left;                   /* rotate right, then recurse */
+	root->left = q->right;
+	q->right = root;
+	q->right = delete_range(root, lo);
+	return q;
+    }
+    else {
+	q = root->right;                  /* rotate left, then recurse */
+	root->right = q->left;
+	q->left = root;
+	q->left = delete_range(root, lo);
+	return q;
+    }
+    return root;
+}
+
+
+/*****************************************************************
+ * The following routines manipulate the id map, which holds the 
+ * blocks of a streamed trace that are currently live.
+ ****************************************************************/
+
+/* Slot where id would be found, if there were no collisions */
+#define IDMAP_HOME(map, id) \
+    (((unsigned)(id) * 0x9e3779b1u) >> (32 - (map)->bits))
+
+/*
+ * idmap_init - make map an empty table of 1 << bits slots
+ */
+static void idmap_init(idmap_t *map, int bits)
+{
+    int i;
+
+    map->bits = bits;
+    map->count = 0;
+    if ((map->slots = 
+	 (idslot_t *)malloc(sizeof(idslot_t) << bits)) == NULL)
+	unix_error("malloc failed in idmap_init");
+    for (i = 0; i < (1 << bits); i++)
+	map->slots[i].id = -1;
+}
+
+/*
+ * idmap_find - the slot of id, or NULL if id is not live
+ */
+static idslot_t *idmap_find(idmap_t *map, int id)
+{
+    unsigned mask = (1u << map->bits) - 1;
+    unsigned i = IDMAP_HOME(map, id);
+
+    while (map->slots[i].id != id) {
+	if (map->slots[i].id < 0)
+	    return NULL;
+	i = (i + 1) & mask;
+    }
+    return &map->slots[i];
+}
+
+/*
+ * idmap_add - claim a slot for id and return it, or NULL if id is 
+ *     already live. Doubles the table once it would be over half full.
+ */
+static idslot_t *idmap_add(idmap_t *map, int id)
+{
+    idmap_t old;
+    unsigned mask, i;
+    int j;
+
+    if (2 * (map->count + 1) > (1 << map->bits)) {
+	old = *map;
+	idmap_init(map, old.bits + 1);
+	for (j = 0; j < (1 << old.bits); j++)
+	    if (old.slots[j].id >= 0)
+		*idmap_add(map, old.slots[j].id) = old.slots[j];
+	free(old.slots);
+    }
+
+    mask = (1u << map->bits) - 1;
+    for (i = IDMAP_HOME(map, id); map->slots[i].id >= 0; i = (i + 1) & mask)
+	if (map->slots[i].id == id)
+	    return NULL;
+    map->slots[i].id = id;
+    map->count++;
+    return &map->slots[i];
+}
+
+/*
+ * idmap_remove - empty a slot returned by idmap_find, moving back 
+ *     any later entries of its run that would no longer be found
+ */
+static void idmap_remove(idmap_t *map, idslot_t *slot)
+{
+    unsigned mask = (1u << map->bits) - 1;
+    unsigned i = slot - map->slots, j = i, home;
+
+    for (;;) {
+	j = (j + 1) & mask;
+	if (map->slots[j].id < 0)
+	    break;
+	home = IDMAP_HOME(map, map->slots[j].id);
+	/* Move the entry at j to i unless its home lies in (i, j] */
+	if ((i < j) ? (home <= i || home > j) : (home <= i && home > j)) {
+	    map->slots[i] = map->slots[j];
+	    i = j;
+	}
+    }
+    map->slots[i].id = -1;
+    map->count--;
+}
+
 
 /**********************************************
  * The following routines manipulate tracefiles
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. Binary traces
+ *     (see write_btrace) are recognized by their magic number and mapped
+ *     instead of parsed, and compressed ones (see write_ztrace) are 
+ *     decoded.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
@@ -480,6 +1001,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     unsigned index, size;
     unsigned max_index = 0;
     unsigned op_index;
+    unsigned magic = 0;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -487,6 +1009,8 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
 	unix_error("malloc 1 failed in read_trance");
+    trace->map = NULL;
+    trace->map_len = 0;
 	
     /* Read the trace file header */
     strcpy(path, tracedir);
@@ -495,6 +1019,18 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
+    if (fread(&magic, sizeof(magic), 1, tracefile) == 1 && 
+	magic == BTRACE_MAGIC) {
+	read_btrace(trace, fileno(tracefile), path);
+	fclose(tracefile);
+	return trace;
+    }
+    if (magic == ZTRACE_MAGIC) {
+	read_ztrace(trace, fileno(tracefile), path);
+	fclose(tracefile);
+	return trace;
+    }
+    rewind(tracefile);
     fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
     fscanf(tracefile, "%d", &(trace->num_ids));     
     fscanf(tracefile, "%d", &(trace->num_ops));     
@@ -554,13 +1090,235 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * read_btrace - map the op records of the binary trace open on fd
+ *     directly into trace->ops. Only the header is examined; the
+ *     records are used in place without any parsing.
+ */
+static void read_btrace(trace_t *trace, int fd, char *path)
+{
+    struct stat st;
+    btrace_hdr_t *hdr;
+
+    if (fstat(fd, &st) < 0)
+	unix_error("fstat failed in read_btrace");
+    if ((size_t)st.st_size < sizeof(btrace_hdr_t)) {
+	sprintf(msg, "Truncated binary trace header in %s", path);
+	app_error(msg);
+    }
+
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED)
+	unix_error("mmap failed in read_btrace");
+
+    hdr = (btrace_hdr_t *)trace->map;
+    if (hdr->version != BTRACE_VERSION || hdr->num_ops < 0 || 
+	hdr->num_ids < 0 || trace->map_len != sizeof(btrace_hdr_t) + 
+	(size_t)hdr->num_ops * sizeof(traceop_t)) {
+	sprintf(msg, "Bad binary trace header in %s", path);
+	app_error(msg);
+    }
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+    check_ops(trace, path);
+
+    /* The per-id arrays are still private to this run (at least one
+       entry, so that an empty trace does not ask malloc for 0 bytes) */
+    if ((trace->blocks = 
+	 (char **)malloc((trace->num_ids + 1) * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_btrace");
+    if ((trace->block_sizes = 
+	 (size_t *)malloc((trace->num_ids + 1) * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_btrace");
+}
+
+/*
+ * check_ops - make sure that every op of a trace that was not parsed 
+ *     from text has a known type, a size that is not negative, and an 
+ *     id below num_ids, since the ids index the per-id arrays directly
+ */
+static void check_ops(trace_t *trace, char *path)
+{
+    traceop_t *op;
+    int i;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if ((unsigned)op->type > REALLOC || op->size < 0 || 
+	    op->index < 0 || op->index >= trace->num_ids) {
+	    sprintf(msg, "Bad op %d (type %d, id %d, size %d) in %s", 
+		    i, (int)op->type, op->index, op->size, path);
+	    app_error(msg);
+	}
+    }
+}
+
+/*
+ * write_btrace - write a trace in the binary format read by read_btrace
+ */
+static void write_btrace(trace_t *trace, char *path)
+{
+    FILE *fp;
+    btrace_hdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = BTRACE_MAGIC;
+    hdr.version = BTRACE_VERSION;
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_btrace", path);
+	unix_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || 
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, fp) != 
+	(size_t)trace->num_ops)
+	unix_error("fwrite failed in write_btrace");
+    if (fclose(fp) != 0)
+	unix_error("fclose failed in write_btrace");
+}
+
+/*
+ * read_ztrace - decode the whole compressed trace open on fd into 
+ *     trace->ops. The file is mapped only while it is decoded.
+ */
+static void read_ztrace(trace_t *trace, int fd, char *path)
+{
+    struct stat st;
+    char *map;
+    ztrace_hdr_t *hdr;
+    ztrace_ctx_t z;
+    const unsigned char *p, *end;
+    int n;
+    double start = 0;
+
+    if (fstat(fd, &st) < 0)
+	unix_error("fstat failed in read_ztrace");
+    if ((size_t)st.st_size < sizeof(ztrace_hdr_t)) {
+	sprintf(msg, "Truncated compressed trace header in %s", path);
+	app_error(msg);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+	unix_error("mmap failed in read_ztrace");
+
+    hdr = (ztrace_hdr_t *)map;
+    if (hdr->version != ZTRACE_VERSION || hdr->num_ops < 0 || 
+	hdr->num_ids < 0) {
+	sprintf(msg, "Bad compressed trace header in %s", path);
+	app_error(msg);
+    }
+    if (hdr->num_ops > 0x7fffffff) {
+	sprintf(msg, "%s has too many ops to load; stream it with -S", path);
+	app_error(msg);
+    }
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = (int)hdr->num_ops;
+    trace->weight = hdr->weight;
+
+    /* At least one entry each, as in read_btrace */
+    if ((trace->ops = 
+	 (traceop_t *)malloc((trace->num_ops + 1) * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_ztrace");
+    if ((trace->blocks = 
+	 (char **)malloc((trace->num_ids + 1) * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_ztrace");
+    if ((trace->block_sizes = 
+	 (size_t *)malloc((trace->num_ids + 1) * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_ztrace");
+
+    if (verbose > 1)
+	start = now_ns();
+    ztrace_init(&z);
+    p = (const unsigned char *)(hdr + 1);
+    end = (const unsigned char *)map + st.st_size;
+    n = ztrace_decode(&z, &p, end, trace->ops, trace->num_ops);
+    if (n != trace->num_ops || p != end) {
+	sprintf(msg, "Bad or truncated compressed trace %s", path);
+	app_error(msg);
+    }
+    if (verbose > 1)
+	printf("Decoded %d ops in %.6f secs\n", n, (now_ns() - start) / 1e9);
+    munmap(map, st.st_size);
+
+    /* The decoder only knows the ids it has seen, not num_ids */
+    check_ops(trace, path);
+}
+
+/*
+ * write_ztrace - compress the trace at inpath, which may be in any 
+ *     format, into outpath. Return the number of ops written.
+ */
+static long long write_ztrace(char *inpath, char *outpath)
+{
+    tstream_t *s;
+    traceop_t *ops;
+    ztrace_hdr_t hdr;
+    ztrace_ctx_t z;
+    FILE *fp;
+    unsigned char *buf;
+    size_t len;
+    int i, n, cap = 0;
+
+    if ((s = tstream_open(inpath)) == NULL)
+	exit(1);
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = ZTRACE_MAGIC;
+    hdr.version = ZTRACE_VERSION;
+    tstream_header(s, &hdr.sugg_heapsize, &hdr.num_ids, &hdr.num_ops, 
+		   &hdr.weight);
+
+    if ((fp = fopen(outpath, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_ztrace", outpath);
+	unix_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+	unix_error("fwrite failed in write_ztrace");
+
+    ztrace_init(&z);
+    buf = NULL;
+    while ((n = tstream_next(s, &ops)) > 0) {
+	if (n > cap) {
+	    cap = n;
+	    if ((buf = (unsigned char *)realloc(buf, cap * ZTRACE_MAXOP)) == NULL)
+		unix_error("realloc failed in write_ztrace");
+	}
+	for (len = 0, i = 0; i < n; i++)
+	    len += ztrace_encode(&z, &ops[i], buf + len);
+	if (fwrite(buf, 1, len, fp) != len)
+	    unix_error("fwrite failed in write_ztrace");
+    }
+    if (n < 0) {
+	fclose(fp);
+	unlink(outpath);
+	exit(1);
+    }
+    if (fclose(fp) != 0)
+	unix_error("fclose failed in write_ztrace");
+    free(buf);
+    tstream_close(s);
+    return hdr.num_ops;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(). For
+ *              binary traces the ops array is unmapped instead.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* free the three arrays... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
@@ -584,12 +1342,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (alloc->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -604,14 +1362,14 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = alloc->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
@@ -633,15 +1391,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = alloc->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -653,7 +1411,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -668,10 +1426,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case FREE: /* mm_free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Remove region from tree and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    alloc->free(p);
 	    break;
 
 	default:
@@ -689,35 +1447,43 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   largest size of the heap in bytes while running the student's 
+ *   malloc package on the trace. Since mem_sbrk() lets the students 
+ *   decrement the brk pointer, we sample it after every request.
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *heap, double *live)
 {   
     int i;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    size_t max_heap_size = 0;
     char *p;
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (alloc->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	/* 
+	 * The heap may shrink again, so remember the high water mark of
+	 * the heap plus any mappings outside it
+	 */
+	if (mem_heapsize() + mem_mapsize() > max_heap_size)
+	    max_heap_size = mem_heapsize() + mem_mapsize();
+
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = alloc->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -739,7 +1505,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = alloc->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -760,7 +1526,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    alloc->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -773,8 +1539,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
         }
     }
+    if (mem_heapsize() + mem_mapsize() > max_heap_size)
+	max_heap_size = mem_heapsize() + mem_mapsize();
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    *heap = max_heap_size;
+    *live = max_total_size;
+    return ((double)max_total_size / (double)max_heap_size);
 }
 
 
@@ -790,7 +1560,7 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (alloc->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -800,7 +1570,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = alloc->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -809,7 +1579,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = alloc->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -817,7 +1587,7 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            alloc->free(block);
             break;
 
 	default:
@@ -825,6 +1595,457 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * now_ns - CLOCK_MONOTONIC time in ns
+ */
+static unsigned long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * eval_mm_latency - Replay the trace once like eval_mm_speed, and
+ *     add the time each request took to the histogram of its type.
+ *     One timestamp per op both ends the last op and starts the next.
+ */
+static void eval_mm_latency(trace_t *trace, hist_t *lat)
+{
+    int i, index;
+    char *p;
+    unsigned long start, end;
+
+    for (i = 0; i < NUM_OPTYPES; i++)
+	hist_reset(&lat[i]);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (alloc->init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    start = now_ns();
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = alloc->malloc(trace->ops[i].size)) == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+            if ((p = alloc->realloc(trace->blocks[index], 
+				trace->ops[i].size)) == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            alloc->free(trace->blocks[index]);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+        }
+	end = now_ns();
+	hist_add(&lat[trace->ops[i].type], end - start);
+	start = end;
+    }
+}
+
+/*
+ * eval_mm_gen - Replay a generated workload GEN_CHUNK ops at a time, 
+ *     as the generator makes them up, so it never has to fit in memory.
+ *     Only the calls to the malloc package are timed. Utilization is 
+ *     the peak live payload over the peak heap size.
+ */
+static void eval_mm_gen(char *spec, stats_t *stats)
+{
+    mmgen_t *g;
+    traceop_t *ops;
+    char **blocks = NULL;
+    int num_blocks = 0;
+    int i, n, index;
+    struct timespec start, end;
+
+    if ((g = mmgen_new(spec)) == NULL)
+	exit(1);
+    if ((ops = (traceop_t *)malloc(GEN_CHUNK * sizeof(traceop_t))) == NULL)
+	unix_error("malloc failed in eval_mm_gen");
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (alloc->init() < 0) 
+	app_error("mm_init failed in eval_mm_gen");
+
+    stats->valid = 1;
+    while (stats->valid && (n = mmgen_next(g, ops, GEN_CHUNK)) > 0) {
+	if (mmgen_num_ids(g) > num_blocks) {
+	    num_blocks = mmgen_num_ids(g);
+	    blocks = (char **)realloc(blocks, num_blocks * sizeof(char *));
+	    if (blocks == NULL)
+		unix_error("realloc failed in eval_mm_gen");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	for (i = 0;  i < n;  i++) {
+	    index = ops[i].index;
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((blocks[index] = alloc->malloc(ops[i].size)) == NULL)
+		    stats->valid = 0;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((blocks[index] = alloc->realloc(blocks[index], 
+						    ops[i].size)) == NULL)
+		    stats->valid = 0;
+		break;
+
+	    case FREE: /* mm_free */
+		alloc->free(blocks[index]);
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_gen");
+	    }
+	    if (!stats->valid) {
+		errors++;
+		printf("ERROR [generated op %.0f]: mm_malloc or mm_realloc "
+		       "failed\n", stats->ops + i);
+#if !USE_VM_HEAP
+		/* Most likely the live set outgrew the MAX_HEAP array */
+		printf("The heap is capped at %d MB; cap the live set with "
+		       "live=, or build with make VMHEAP=1\n", MAX_HEAP >> 20);
+#endif
+		break;
+	    }
+	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+	stats->secs += (end.tv_sec - start.tv_sec) + 
+	    1e-9 * (end.tv_nsec - start.tv_nsec);
+	stats->ops += n;
+    }
+
+    stats->live = mmgen_peak_live(g);
+    stats->heap = mem_peaksize();
+    stats->util = stats->heap > 0 ? stats->live / stats->heap : 0;
+    free(blocks);
+    free(ops);
+    mmgen_free(g);
+}
+
+/*
+ * eval_mm_stream - Replay a trace as a separate thread reads it in,
+ *     so it never has to fit in memory (see tstream.c). The live 
+ *     blocks are kept in an id map instead of an array indexed by id.
+ *     As in eval_mm_gen, the blocks are not checked and only the chunk
+ *     loops are timed, map lookups included. Utilization is the peak 
+ *     live payload over the peak heap size.
+ */
+static void eval_mm_stream(char *path, stats_t *stats)
+{
+    tstream_t *s;
+    traceop_t *ops;
+    idmap_t map;
+    idslot_t *slot;
+    char *p;
+    int i, n, index;
+    double live = 0;
+    struct timespec start, end;
+
+    if ((s = tstream_open(path)) == NULL)
+	exit(1);
+    idmap_init(&map, 10);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (alloc->init() < 0) 
+	app_error("mm_init failed in eval_mm_stream");
+
+    stats->valid = 1;
+    while (stats->valid && (n = tstream_next(s, &ops)) > 0) {
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	for (i = 0;  i < n;  i++) {
+	    index = ops[i].index;
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = alloc->malloc(ops[i].size)) == NULL) {
+		    sprintf(msg, "mm_malloc failed.");
+		    stats->valid = 0;
+		}
+		else if ((slot = idmap_add(&map, index)) == NULL) {
+		    sprintf(msg, "Id %d is allocated while live", index);
+		    stats->valid = 0;
+		}
+		else {
+		    slot->p = p;
+		    slot->size = ops[i].size;
+		    live += ops[i].size;
+		}
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((slot = idmap_find(&map, index)) == NULL) {
+		    sprintf(msg, "Id %d is reallocated while not live", index);
+		    stats->valid = 0;
+		}
+		else if ((p = alloc->realloc(slot->p, ops[i].size)) == NULL) {
+		    sprintf(msg, "mm_realloc failed.");
+		    stats->valid = 0;
+		}
+		else {
+		    slot->p = p;
+		    live += ops[i].size - slot->size;
+		    slot->size = ops[i].size;
+		}
+		break;
+
+	    case FREE: /* mm_free */
+		if ((slot = idmap_find(&map, index)) == NULL) {
+		    sprintf(msg, "Id %d is freed while not live", index);
+		    stats->valid = 0;
+		}
+		else {
+		    alloc->free(slot->p);
+		    live -= slot->size;
+		    idmap_remove(&map, slot);
+		}
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_stream");
+	    }
+	    if (!stats->valid) {
+		errors++;
+		printf("ERROR [op %.0f]: %s\n", stats->ops + i, msg);
+		break;
+	    }
+	    if (live > stats->live)
+		stats->live = live;
+	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+	stats->secs += (end.tv_sec - start.tv_sec) + 
+	    1e-9 * (end.tv_nsec - start.tv_nsec);
+	stats->ops += n;
+    }
+    if (n < 0) {
+	errors++;
+	stats->valid = 0;
+    }
+
+    stats->heap = mem_peaksize();
+    stats->util = stats->heap > 0 ? stats->live / stats->heap : 0;
+    free(map.slots);
+    tstream_close(s);
+}
+
+/*
+ * eval_mm_threads - Replay a trace on nthreads threads at the same time
+ *    and record the wall clock and per-thread running times. In MT_COPY
+ *    mode each thread replays the whole trace on its own block array.
+ *    Otherwise the ids are dealt out round robin, and in MT_XFREE mode
+ *    the blocks of each thread are freed by the next thread, which waits
+ *    until the owner has done every alloc and realloc on that id. If
+ *    the trace uses an id again, the owner's alloc in turn waits for the
+ *    earlier frees of it. Every wait is for an earlier op in the trace,
+ *    so this cannot deadlock.
+ */
+static void eval_mm_threads(trace_t *trace, int tracenum, int nthreads, 
+			    int mode, mt_stats_t *stats)
+{
+    int i, t, index;
+    int failed = 0;
+    int *seen = NULL;
+    int *seen_frees = NULL;
+    int *need = NULL;
+    int *ready = NULL;
+    int *freed = NULL;
+    mt_arg_t *args;
+    pthread_t *tids;
+    pthread_barrier_t barrier;
+    double start, end;
+
+    if ((args = (mt_arg_t *)calloc(nthreads, sizeof(mt_arg_t))) == NULL ||
+	(tids = (pthread_t *)calloc(nthreads, sizeof(pthread_t))) == NULL ||
+	(stats->tops = (double *)calloc(nthreads, sizeof(double))) == NULL ||
+	(stats->tsecs = (double *)calloc(nthreads, sizeof(double))) == NULL)
+	unix_error("calloc failed in eval_mm_threads");
+
+    /* Work out which ops each thread does */
+    if (mode == MT_XFREE) {
+	if ((seen = (int *)calloc(trace->num_ids, sizeof(int))) == NULL ||
+	    (need = (int *)calloc(trace->num_ops, sizeof(int))) == NULL ||
+	    (seen_frees = (int *)calloc(trace->num_ids, sizeof(int))) == NULL ||
+	    (ready = (int *)calloc(trace->num_ids, sizeof(int))) == NULL ||
+	    (freed = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+	    unix_error("calloc failed in eval_mm_threads");
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    index = trace->ops[i].index;
+	    if (trace->ops[i].type == FREE) {
+		need[i] = seen[index];
+		seen_frees[index]++;
+	    }
+	    else {
+		if (trace->ops[i].type == ALLOC)
+		    need[i] = seen_frees[index];
+		seen[index]++;
+	    }
+	}
+	free(seen);
+	free(seen_frees);
+    }
+    for (t = 0;  t < nthreads;  t++) {
+	args[t].trace = trace;
+	args[t].ready = ready;
+	args[t].freed = freed;
+	args[t].need = need;
+	args[t].barrier = &barrier;
+	args[t].failed = &failed;
+	if (mode == MT_COPY) {
+	    args[t].num_ops = trace->num_ops;
+	    args[t].opidx = NULL;
+	    if ((args[t].blocks = 
+		 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+		unix_error("malloc failed in eval_mm_threads");
+	    continue;
+	}
+	args[t].blocks = trace->blocks;
+	if ((args[t].opidx = 
+	     (int *)malloc(trace->num_ops * sizeof(int))) == NULL)
+	    unix_error("malloc failed in eval_mm_threads");
+    }
+    if (mode != MT_COPY) {
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    index = trace->ops[i].index;
+	    t = index % nthreads;
+	    if (mode == MT_XFREE && trace->ops[i].type == FREE)
+		t = (t + 1) % nthreads;
+	    args[t].opidx[args[t].num_ops++] = i;
+	}
+    }
+
+    /* Reset the heap and run all threads from a common starting line */
+    mem_reset_brk();
+    if (alloc->init() < 0)
+	app_error("mm_init failed in eval_mm_threads");
+    pthread_barrier_init(&barrier, NULL, nthreads + 1);
+    for (t = 0;  t < nthreads;  t++)
+	if ((errno = pthread_create(&tids[t], NULL, mt_replay, &args[t])) != 0)
+	    unix_error("pthread_create failed in eval_mm_threads");
+    pthread_barrier_wait(&barrier);
+    for (t = 0;  t < nthreads;  t++)
+	pthread_join(tids[t], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    /* The wall clock time runs from the first start to the last finish */
+    stats->valid = !failed;
+    if (failed)
+	printf("ERROR [trace %d]: mm_malloc or mm_realloc failed "
+	       "in the %d-thread replay\n", tracenum, nthreads);
+    stats->ops = 0;
+    start = args[0].start;
+    end = args[0].end;
+    for (t = 0;  t < nthreads;  t++) {
+	stats->tops[t] = args[t].num_ops;
+	stats->tsecs[t] = args[t].end - args[t].start;
+	stats->ops += args[t].num_ops;
+	start = (args[t].start < start) ? args[t].start : start;
+	end = (args[t].end > end) ? args[t].end : end;
+	if (mode == MT_COPY)
+	    free(args[t].blocks);
+	else
+	    free(args[t].opidx);
+    }
+    stats->secs = end - start;
+    free(ready);
+    free(freed);
+    free(need);
+    free(tids);
+    free(args);
+}
+
+/*
+ * mt_replay - The body of each thread started by eval_mm_threads
+ */
+static void *mt_replay(void *ptr)
+{
+    mt_arg_t *arg = (mt_arg_t *)ptr;
+    traceop_t *op;
+    struct timespec ts;
+    int i, opnum, index;
+    char *p;
+
+    pthread_barrier_wait(arg->barrier);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    arg->start = ts.tv_sec + 1e-9 * ts.tv_nsec;
+
+    for (i = 0;  i < arg->num_ops;  i++) {
+	opnum = (arg->opidx != NULL) ? arg->opidx[i] : i;
+	op = &arg->trace->ops[opnum];
+	index = op->index;
+
+	switch (op->type) {
+	case ALLOC: /* mm_malloc */
+	    /* An id used again must not take the slot before its last
+	       block was freed by the other thread */
+	    if (arg->ready != NULL)
+		while (__atomic_load_n(&arg->freed[index], __ATOMIC_ACQUIRE) <
+		       arg->need[opnum]) {
+		    if (__atomic_load_n(arg->failed, __ATOMIC_RELAXED))
+			goto fail;
+		    sched_yield();
+		}
+	    if ((p = alloc->malloc(op->size)) == NULL)
+		goto fail;
+	    arg->blocks[index] = p;
+	    if (arg->ready != NULL)
+		__atomic_add_fetch(&arg->ready[index], 1, __ATOMIC_RELEASE);
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((p = alloc->realloc(arg->blocks[index], op->size)) == NULL)
+		goto fail;
+	    arg->blocks[index] = p;
+	    if (arg->ready != NULL)
+		__atomic_add_fetch(&arg->ready[index], 1, __ATOMIC_RELEASE);
+	    break;
+
+	case FREE: /* mm_free */
+	    if (arg->ready != NULL)
+		while (__atomic_load_n(&arg->ready[index], __ATOMIC_ACQUIRE) <
+		       arg->need[opnum]) {
+		    if (__atomic_load_n(arg->failed, __ATOMIC_RELAXED))
+			goto fail;
+		    sched_yield();
+		}
+	    alloc->free(arg->blocks[index]);
+	    if (arg->freed != NULL)
+		__atomic_add_fetch(&arg->freed[index], 1, __ATOMIC_RELEASE);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in mt_replay");
+	}
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    arg->end = ts.tv_sec + 1e-9 * ts.tv_nsec;
+    return NULL;
+
+ fail:
+    /* Stop, and make any thread waiting on us stop as well */
+    __atomic_store_n(arg->failed, 1, __ATOMIC_RELAXED);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    arg->end = ts.tv_sec + 1e-9 * ts.tv_nsec;
+    return NULL;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -920,29 +2141,50 @@ static void eval_libc_speed(void *ptr)
  */
 static void printresults(int n, stats_t *stats) 
 {
-    int i;
+    int i, j;
     double secs = 0;
     double ops = 0;
     double util = 0;
+    perfctr_t total;  /* counters summed over all traces */
+
+    for (j=0; j < PERFCTR_NUM; j++) {
+	total.valid[j] = 1;
+	total.count[j] = 0;
+    }
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
+    printf("%5s%7s %5s%8s%10s%8s", 
 	   "trace", " valid", "util", "ops", "secs", "Kops");
+    if (spread)
+	printf("%10s%7s", "min secs", "ci95");
+    if (perf)
+	for (j=0; j < PERFCTR_NUM; j++)
+	    printf("%8s", perfctr_name(j));
+    printf("\n");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (spread)
+		printf("%10.6f%6.1f%%", stats[i].min_secs, stats[i].ci*100.0);
+	    if (perf)
+		printcounters(&stats[i].ctr, stats[i].ops);
+	    printf("\n");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    for (j=0; j < PERFCTR_NUM; j++) {
+		total.valid[j] &= stats[i].ctr.valid[j];
+		total.count[j] += stats[i].ctr.count[j];
+	    }
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%8s\n", 
 		   i,
 		   "no",
 		   "-",
@@ -954,15 +2196,20 @@ static void printresults(int n, stats_t *stats)
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%8.0f%10.6f%8.0f", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
 	       secs,
 	       (ops/1e3)/secs);
+	if (spread && perf)
+	    printf("%17s", "");
+	if (perf)
+	    printcounters(&total, ops);
+	printf("\n");
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%8s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
@@ -972,6 +2219,303 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcounters - prints the hardware counters of a run as events per
+ *     op, with a dash for each counter that was unavailable
+ */
+static void printcounters(perfctr_t *ctr, double ops)
+{
+    int j;
+
+    for (j=0; j < PERFCTR_NUM; j++) {
+	if (ctr->valid[j])
+	    printf("%8.2f", ctr->count[j]/ops);
+	else
+	    printf("%8s", "-");
+    }
+}
+
+/*
+ * printlatency - prints the median, tail, and maximum latency of each
+ *     op type in each trace
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    static char *opnames[NUM_OPTYPES] = {"malloc", "free", "realloc"};
+    int i, t;
+    hist_t *h;
+
+    printf("%5s%9s%8s%8s%8s%8s%9s\n", 
+	   "trace", "op", "ops", "p50", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%12s%8s%8s%8s%8s%9s\n", i, "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	for (t=0; t < NUM_OPTYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->n == 0)
+		continue;
+	    printf("%2d%12s%8lu%8lu%8lu%8lu%9lu\n", 
+		   i,
+		   opnames[t],
+		   h->n,
+		   hist_quantile(h, 0.5),
+		   hist_quantile(h, 0.99),
+		   hist_quantile(h, 0.999),
+		   h->max);
+	}
+    }
+}
+
+/*
+ * printmtresults - prints aggregate and per-thread throughput of the
+ *     multi-threaded replays
+ */
+static void printmtresults(int n, int nthreads, mt_stats_t *stats)
+{
+    int i, t;
+
+    printf("%5s%7s%9s%10s%9s\n", 
+	   "trace", "thread", "ops", "secs", "Kops");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%10s%9s%10s%9s\n", i, "-", "-", "-", "-");
+	    continue;
+	}
+	for (t=0; t < nthreads; t++)
+	    printf("%2d%10d%9.0f%10.6f%9.0f\n", 
+		   i,
+		   t,
+		   stats[i].tops[t],
+		   stats[i].tsecs[t],
+		   (stats[i].tops[t]/1e3)/stats[i].tsecs[t]);
+	printf("%2d%10s%9.0f%10.6f%9.0f\n", 
+	       i,
+	       "all",
+	       stats[i].ops,
+	       stats[i].secs,
+	       (stats[i].ops/1e3)/stats[i].secs);
+    }
+}
+
+/*
+ * printcompare - prints the util and throughput of m malloc packages 
+ *     on each trace side by side, followed by their perf indexes
+ */
+static void printcompare(int n, int m, allocator_t **allocs, 
+			 stats_t **stats, double *perfidx)
+{
+    int i, a;
+    double ops, secs, util;
+
+    printf("Comparison of malloc packages:\n%5s", "trace");
+    for (a=0; a < m; a++)
+	printf("%15s", allocs[a]->name);
+    printf("\n%5s", "");
+    for (a=0; a < m; a++)
+	printf("%6s%9s", "util", "Kops");
+    printf("\n");
+
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	for (a=0; a < m; a++) {
+	    if (stats[a][i].valid)
+		printf("%5.0f%%%9.0f", stats[a][i].util*100.0,
+		       (stats[a][i].ops/1e3)/stats[a][i].secs);
+	    else
+		printf("%6s%9s", "-", "-");
+	}
+	printf("\n");
+    }
+
+    printf("%5s", "Total");
+    for (a=0; a < m; a++) {
+	ops = secs = util = 0;
+	for (i=0; i < n; i++) {
+	    ops += stats[a][i].ops;
+	    secs += stats[a][i].secs;
+	    util += stats[a][i].util;
+	}
+	printf("%5.0f%%%9.0f", (util/n)*100.0, (ops/1e3)/secs);
+    }
+    printf("\n%5s", "Index");
+    for (a=0; a < m; a++)
+	printf("%15.0f", perfidx[a]);
+    printf("\n\n");
+}
+
+/*
+ * select_allocators - Fill allocs with the packages named in a comma
+ *     separated list, or with all of them for "all". Return how many
+ *     there are, or 0 if a name is unknown or there are too many.
+ */
+static int select_allocators(char *list, allocator_t **allocs)
+{
+    char *names, *name;
+    int m = 0;
+
+    if (!strcmp(list, "all")) {
+	for (m = 0; allocators[m].name != NULL; m++)
+	    allocs[m] = &allocators[m];
+	return m;
+    }
+    if ((names = strdup(list)) == NULL)
+	unix_error("strdup failed in select_allocators");
+    for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+	if (m == NUM_ALLOCATORS || (allocs[m] = find_allocator(name)) == NULL) {
+	    fprintf(stderr, "Unknown malloc package %s\n", name);
+	    free(names);
+	    return 0;
+	}
+	m++;
+    }
+    free(names);
+    return m;
+}
+
+/*
+ * open_output - Open the -o results file; its extension picks the format
+ */
+static void open_output(char *path)
+{
+    char *ext = strrchr(path, '.');
+
+    if (ext != NULL && !strcmp(ext, ".json"))
+	out_json = 1;
+    else if (ext != NULL && !strcmp(ext, ".csv"))
+	out_json = 0;
+    else
+	app_error("The -o file must end in .json or .csv");
+
+    if ((out = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s for writing", path);
+	unix_error(msg);
+    }
+    if (out_json)
+	fprintf(out, "{\n  \"results\": [");
+    else
+	fprintf(out, "allocator,trace,valid,ops,secs,kops,util,heap,peak_live,"
+		"min_secs,ci95\n");
+}
+
+/*
+ * write_string - Write str to the -o results file as a JSON string, or
+ *     as a CSV field, quoted only if it has to be
+ */
+static void write_string(char *str)
+{
+    char *p;
+
+    if (out_json) {
+	putc('"', out);
+	for (p = str; *p; p++) {
+	    if (*p == '"' || *p == '\\')
+		fprintf(out, "\\%c", *p);
+	    else if ((unsigned char)*p < 0x20)
+		fprintf(out, "\\u%04x", (unsigned char)*p);
+	    else
+		putc(*p, out);
+	}
+	putc('"', out);
+    }
+    else if (strpbrk(str, ",\"\r\n") != NULL) {
+	putc('"', out);
+	for (p = str; *p; p++) {
+	    if (*p == '"')
+		putc('"', out);
+	    putc(*p, out);
+	}
+	putc('"', out);
+    }
+    else
+	fputs(str, out);
+}
+
+/*
+ * write_output - Write one record per trace for some malloc package to 
+ *     the -o results file. Fields that were not measured are null in 
+ *     JSON and empty in CSV; util, heap, and peak_live are only measured
+ *     if space is set.
+ */
+static void write_output(char *name, char **tracefiles, int n, 
+			 stats_t *stats, int space)
+{
+    int i;
+    stats_t *s;
+
+    for (i=0; i < n; i++) {
+	s = &stats[i];
+	if (out_json) {
+	    fprintf(out, "%s\n    {\"allocator\": ", out_count ? "," : "");
+	    write_string(name);
+	    fprintf(out, ", \"trace\": ");
+	    write_string(tracefiles[i]);
+	    fprintf(out, ", \"valid\": %s, \"ops\": %.0f", 
+		    s->valid ? "true" : "false", s->ops);
+	    if (s->valid)
+		fprintf(out, ", \"secs\": %.9f, \"kops\": %.3f", 
+			s->secs, (s->ops/1e3)/s->secs);
+	    else
+		fprintf(out, ", \"secs\": null, \"kops\": null");
+	    if (s->valid && space)
+		fprintf(out, ", \"util\": %.6f, \"heap\": %.0f, "
+			"\"peak_live\": %.0f", s->util, s->heap, s->live);
+	    else
+		fprintf(out, ", \"util\": null, \"heap\": null, "
+			"\"peak_live\": null");
+	    if (s->valid && spread)
+		fprintf(out, ", \"min_secs\": %.9f, \"ci95\": %.6f}", 
+			s->min_secs, s->ci);
+	    else
+		fprintf(out, ", \"min_secs\": null, \"ci95\": null}");
+	}
+	else {
+	    write_string(name);
+	    putc(',', out);
+	    write_string(tracefiles[i]);
+	    fprintf(out, ",%d,%.0f", s->valid, s->ops);
+	    if (s->valid) {
+		fprintf(out, ",%.9f,%.3f", s->secs, (s->ops/1e3)/s->secs);
+		if (space)
+		    fprintf(out, ",%.6f,%.0f,%.0f", s->util, s->heap, s->live);
+		else
+		    fprintf(out, ",,,");
+		if (spread)
+		    fprintf(out, ",%.9f,%.6f", s->min_secs, s->ci);
+		else
+		    fprintf(out, ",,");
+	    }
+	    else
+		fprintf(out, ",,,,,,,");
+	    fprintf(out, "\n");
+	}
+	out_count++;
+    }
+}
+
+/*
+ * close_output - Finish and close the -o results file. JSON also 
+ *     records the performance index of each of the m packages.
+ */
+static void close_output(int m, allocator_t **allocs, double *perfidx)
+{
+    int a;
+
+    if (out_json) {
+	fprintf(out, "\n  ],\n  \"perfidx\": {");
+	for (a=0; a < m; a++) {
+	    fprintf(out, "%s", a ? ", " : "");
+	    write_string(allocs[a]->name);
+	    fprintf(out, ": %.0f", perfidx[a]);
+	}
+	fprintf(out, "}\n}\n");
+    }
+    if (fclose(out) != 0)
+	unix_error("Could not write the -o results file");
+    out = NULL;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +2548,29 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValLP] [-f <file>] [-t <dir>] [-w <file>]\n");
+    fprintf(stderr, "               [-T <threads>] [-m copy|split|xfree]\n");
+    fprintf(stderr, "               [-W <runs>] [-R <runs>] [-o <file>] [-z <file>]\n");
+    fprintf(stderr, "               [-A all|<name>,...] [-G <spec>] [-S <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A <list>  Compare these packages (e.g. mm,impl or all).\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-G <spec>  Replay a generated workload (see mmgen.c).\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of each op type.\n");
+    fprintf(stderr, "\t-m <mode>  How -T spreads a trace over threads (default split).\n");
+    fprintf(stderr, "\t-o <file>  Also write the results to a .json or .csv file.\n");
+    fprintf(stderr, "\t-P         Count hardware events per op (implies -v).\n");
+    fprintf(stderr, "\t-R <n>     Time n runs of each trace (USE_MONO, default %d).\n", MONO_REPS);
+    fprintf(stderr, "\t-S <file>  Replay <file> as it is read, for traces too big for memory.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on n threads (needs CONCURRENT=1).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <file>  Write the -f trace to <file> in binary format.\n");
+    fprintf(stderr, "\t-W <n>     Do n untimed runs before timing (USE_MONO, default %d).\n", MONO_WARMUP);
+    fprintf(stderr, "\t-z <file>  Write the -f trace to <file> in compressed format.\n");
 }
@@ -2,7 +2,17 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            With USE_VM_HEAP set in config.h, the heap is a reserved 
+ *            (PROT_NONE) range of address space instead. mem_sbrk commits
+ *            pages with mprotect as the brk grows and gives them back with
+ *            madvise(MADV_DONTNEED) when it shrinks.
+ *
+ *            mem_map and friends hand out separate mappings outside the 
+ *            heap for allocators that serve huge requests directly. They
+ *            are tracked so the driver can check payloads against them.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -18,12 +28,45 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+#if USE_VM_HEAP
+static char *mem_commit_brk; /* end of the pages that are committed */
+static size_t mem_page;      /* page size */
+
+static void mem_commit(char *new_brk);
+#endif
+
+/* a live mapping handed out by mem_map */
+typedef struct mem_map_s {
+    char *addr;              /* first byte of the mapping */
+    size_t size;             /* length in bytes, a multiple of the page size */
+    struct mem_map_s *next;
+} mem_map_t;
+
+static mem_map_t *mem_maps;  /* list of live mappings */
+static size_t mem_map_bytes; /* total bytes in live mappings */
+static size_t mem_peak;      /* high water mark of heap plus mappings */
+
+static void mem_unmap_all(void);
+static void mem_note_peak(void);
+static mem_map_t *mem_find_map(void *addr);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
+#if USE_VM_HEAP
+    /* reserve the address range we will use to model the available VM */
+    mem_start_brk = mmap(NULL, MAX_VM_HEAP, PROT_NONE, 
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+    mem_max_addr = mem_start_brk + MAX_VM_HEAP;
+    mem_commit_brk = mem_start_brk;
+    mem_page = mem_pagesize();
+#else
     /* allocate the storage we will use to model the available VM */
     if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
 	fprintf(stderr, "mem_init_vm: malloc error\n");
@@ -31,6 +74,7 @@ void mem_init(void)
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+#endif
     mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
@@ -39,35 +83,202 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
+    mem_unmap_all();
+#if USE_VM_HEAP
+    munmap(mem_start_brk, MAX_VM_HEAP);
+#else
     free(mem_start_brk);
+#endif
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and release any mappings the allocator left behind
  */
 void mem_reset_brk()
 {
+    mem_unmap_all();
     mem_brk = mem_start_brk;
+    mem_peak = 0;
+#if USE_VM_HEAP
+    mem_commit(mem_brk);
+#endif
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, but never below its first byte.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ( ((mem_brk + incr) < mem_start_brk) || 
+	 ((mem_brk + incr) > mem_max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+#if USE_VM_HEAP
+    mem_commit(mem_brk + incr);
+#endif
     mem_brk += incr;
+    mem_note_peak();
     return (void *)old_brk;
 }
 
+#if USE_VM_HEAP
+/*
+ * mem_commit - make exactly the pages below new_brk (rounded up to a 
+ *    page) accessible, committing or releasing pages as needed
+ */
+static void mem_commit(char *new_brk)
+{
+    char *end = mem_start_brk + 
+	(((size_t)(new_brk - mem_start_brk) + mem_page - 1) & ~(mem_page - 1));
+
+    if (end > mem_commit_brk) {
+	if (mprotect(mem_commit_brk, end - mem_commit_brk, 
+		     PROT_READ | PROT_WRITE) < 0) {
+	    fprintf(stderr, "mem_commit: mprotect error\n");
+	    exit(1);
+	}
+    }
+    else if (end < mem_commit_brk) {
+	madvise(end, mem_commit_brk - end, MADV_DONTNEED);
+	mprotect(end, mem_commit_brk - end, PROT_NONE);
+    }
+    mem_commit_brk = end;
+}
+#endif
+
+/*
+ * mem_map - map size bytes (rounded up to a page) of fresh memory
+ *    outside the heap. Returns (void *)-1 on failure, like mem_sbrk.
+ */
+void *mem_map(size_t size)
+{
+    size_t page = mem_pagesize();
+    mem_map_t *m;
+    char *addr;
+
+    size = (size + page - 1) & ~(page - 1);
+    if ((m = malloc(sizeof(mem_map_t))) == NULL) {
+	errno = ENOMEM;
+	return (void *)-1;
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+	free(m);
+	fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    m->addr = addr;
+    m->size = size;
+    m->next = mem_maps;
+    mem_maps = m;
+    mem_map_bytes += size;
+    mem_note_peak();
+    return (void *)addr;
+}
+
+/*
+ * mem_remap - resize the mapping that starts at addr to size bytes 
+ *    (rounded up to a page), moving it if needed. Returns the new start
+ *    address, or (void *)-1 if addr is not a mapping or the resize fails.
+ */
+void *mem_remap(void *addr, size_t size)
+{
+    size_t page = mem_pagesize();
+    mem_map_t *m;
+    char *new_addr;
+
+    if ((m = mem_find_map(addr)) == NULL || m->addr != (char *)addr) {
+	errno = EINVAL;
+	return (void *)-1;
+    }
+    size = (size + page - 1) & ~(page - 1);
+    new_addr = mremap(m->addr, m->size, size, MREMAP_MAYMOVE);
+    if (new_addr == MAP_FAILED) {
+	fprintf(stderr, "ERROR: mem_remap failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    mem_map_bytes += size - m->size;
+    m->addr = new_addr;
+    m->size = size;
+    mem_note_peak();
+    return (void *)new_addr;
+}
+
+/*
+ * mem_unmap - release the mapping that starts at addr
+ */
+int mem_unmap(void *addr)
+{
+    mem_map_t **pp, *m;
+
+    for (pp = &mem_maps; (m = *pp) != NULL; pp = &m->next) {
+	if (m->addr == (char *)addr) {
+	    *pp = m->next;
+	    mem_map_bytes -= m->size;
+	    munmap(m->addr, m->size);
+	    free(m);
+	    return 0;
+	}
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * mem_mapped - return 1 if the bytes lo..hi lie within a single live 
+ *    mapping, and 0 otherwise
+ */
+int mem_mapped(void *lo, void *hi)
+{
+    mem_map_t *m = mem_find_map(lo);
+
+    return m != NULL && (char *)hi < m->addr + m->size;
+}
+
+/*
+ * mem_mapsize - returns the total size in bytes of the live mappings
+ */
+size_t mem_mapsize()
+{
+    return mem_map_bytes;
+}
+
+/*
+ * mem_find_map - return the live mapping that contains addr, or NULL
+ */
+static mem_map_t *mem_find_map(void *addr)
+{
+    mem_map_t *m;
+
+    for (m = mem_maps; m != NULL; m = m->next)
+	if ((char *)addr >= m->addr && (char *)addr < m->addr + m->size)
+	    return m;
+    return NULL;
+}
+
+/*
+ * mem_unmap_all - release every live mapping
+ */
+static void mem_unmap_all(void)
+{
+    mem_map_t *m;
+
+    while ((m = mem_maps) != NULL) {
+	mem_maps = m->next;
+	munmap(m->addr, m->size);
+	free(m);
+    }
+    mem_map_bytes = 0;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +295,25 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_note_peak - raise the high water mark to the current heap plus
+ *    mappings
+ */
+static void mem_note_peak(void)
+{
+    if (mem_heapsize() + mem_map_bytes > mem_peak)
+	mem_peak = mem_heapsize() + mem_map_bytes;
+}
+
+/*
+ * mem_peaksize - returns the largest heap plus mapping size in bytes
+ *    since the last mem_reset_brk
+ */
+size_t mem_peaksize()
+{
+    return mem_peak;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
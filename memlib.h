@@ -7,5 +7,12 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peaksize(void);
 size_t mem_pagesize(void);
 
+void *mem_map(size_t size);
+void *mem_remap(void *addr, size_t size);
+int mem_unmap(void *addr);
+int mem_mapped(void *lo, void *hi);
+size_t mem_mapsize(void);
+
@@ -3,10 +3,41 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 
 #include "mm.h"
 #include "memlib.h"
 
+// MM_CONCURRENT 이 1 이면 여러 스레드에서 동시에 호출할 수 있음
+// (Makefile 의 CONCURRENT 로 설정)
+#ifndef MM_CONCURRENT
+#define MM_CONCURRENT 0
+#endif
+
+#if MM_CONCURRENT
+#include <pthread.h>
+#endif
+
+// MM_SLAB 이 1 이면 SLAB_MAX 이하의 작은 요청은 header 없이 slab 에서 처리
+#ifndef MM_SLAB
+#define MM_SLAB 1
+#endif
+
+// MM_DEFER 가 1 이면 free 한 블록을 바로 병합하지 않고 크기별 quick list 에 두었다가
+// 맞는 블록이 없거나 MM_DEFER_LIMIT 개가 쌓였을 때 한꺼번에 병합
+#ifndef MM_DEFER
+#define MM_DEFER 0
+#endif
+#ifndef MM_DEFER_LIMIT
+#define MM_DEFER_LIMIT 256
+#endif
+
+// MM_COMPACT 가 1 이면 tree 링크를 32bit offset 으로 저장하고 블록을 8 바이트 단위로 나눠
+// 최소 블록이 32 바이트에서 24 바이트로 줄어듦 (heap 은 32GB 까지)
+#ifndef MM_COMPACT
+#define MM_COMPACT 0
+#endif
+
 team_t team = {
     "ateam",
     "junghwan",
@@ -24,13 +55,36 @@ team_t team = {
 #define WSIZE 8
 #define DSIZE 16
 
+// 블록 크기 단위와 최소 블록 (header + tree 링크 두 개 + footer)
+#if MM_COMPACT
+#define BLK_ALIGN WSIZE
+#define MIN_BLOCK (3 * WSIZE)
+#else
+#define BLK_ALIGN DSIZE
+#define MIN_BLOCK (2 * DSIZE)
+#endif
+
 // heap 이 커질 때 확장되는 최소 크기
 #define CHUNKSIZE (1<<7)
+
+// heap 끝의 free 블록이 이 크기 이상이 되면 mem_sbrk 로 돌려줌 (-D 로 변경 가능)
+#ifndef MM_TRIM_THRESHOLD
+#define MM_TRIM_THRESHOLD (1<<16)
+#endif
+// 줄인 뒤에도 이만큼은 free 블록으로 남겨서 임계값 근처에서 줄였다 늘렸다 하지 않게 함
+#define TRIM_PAD MAX(MIN_BLOCK, (MM_TRIM_THRESHOLD / 2) & ~(BLK_ALIGN - 1))
+
+// 이 크기 이상의 요청은 heap 대신 mem_map 으로 따로 mapping 해서 처리 (-D 로 변경 가능)
+#ifndef MM_MMAP_THRESHOLD
+#define MM_MMAP_THRESHOLD (1<<17)
+#endif
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
 
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int *)(p) = (val))
+// header / footer 는 WSIZE 크기 word 전체를 사용 (크기가 4GB 를 넘어도 됨)
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
 
 // 블록의 사이즈 (
 #define GET_SIZE(p) (GET(p) & ~0x7)
@@ -38,6 +92,21 @@ team_t team = {
 // 블록의 allocated 필드 (0 이면 free, 1 이면 allocated 상태를 의미)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+// 이전 블록의 allocated 여부 (footer 는 free 블록에만 있으므로 header 에 기록)
+#define PREV_ALLOC 0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#if MM_CONCURRENT
+// 다음 블록은 다른 thread 가 소유한 allocated 블록일 수 있고, 그 thread 는 tcache fast path 에서
+// lock 없이 자기 블록의 header 를 읽으므로 (OWN_HDR) 이 bit 만큼은 atomic 으로 바꿈
+#define SET_PREV_ALLOC(p) __atomic_fetch_or((size_t *)(p), PREV_ALLOC, __ATOMIC_RELAXED)
+#define CLR_PREV_ALLOC(p) __atomic_fetch_and((size_t *)(p), ~(size_t)PREV_ALLOC, __ATOMIC_RELAXED)
+// lock 없이 자기 블록의 header 를 읽음, 크기는 소유한 동안 바뀌지 않음
+#define OWN_HDR(bp) __atomic_load_n((size_t *)HDRP(bp), __ATOMIC_RELAXED)
+#else
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
+#endif
+
 // header 포인터는 bp 주소 - word size
 #define HDRP(bp) ((char *)(bp) - WSIZE)
 
@@ -51,6 +120,7 @@ team_t team = {
 // │16/1│    │    │16/1│    │ ...
 //                └ bp + 12 - 8
 //                  (char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE
+// allocated 블록에는 footer 가 없음
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
 // 다음 블록포인터 위치
@@ -75,32 +145,226 @@ team_t team = {
 // │16/1│    │    │16/1│12/1│    │12/1│
 //      └ bp - 16
 //        (char *)(bp) - GET_SIZE((char *)(bp) - DSIZE)
+// 이전 블록의 footer 를 읽으므로 이전 블록이 free 일 때만 사용
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DSIZE))
 
-#define PRED(bp) (*(char **)(bp))
-#define SUCC(bp) (*(char **)(bp + WSIZE))
+// free 블록은 (크기, 주소) 순서의 left-leaning red-black tree 로 관리
+// - 왼쪽/오른쪽 자식 링크는 free 블록의 payload 에 저장
+//   MM_COMPACT 에서는 heap 시작 기준 8 바이트 단위 32bit offset 두 개 (0 이 NULL)
+// - 노드 색은 header 의 RED bit 에 저장 (크기가 8 의 배수라 하위 bit 가 남음)
+#define RED 0x4
+#if MM_COMPACT
+#define LEFT(bp) link_ptr(*(unsigned int *)(bp))
+#define RIGHT(bp) link_ptr(*(unsigned int *)((char *)(bp) + 4))
+#define SET_LEFT(bp, p) (*(unsigned int *)(bp) = link_off(p))
+#define SET_RIGHT(bp, p) (*(unsigned int *)((char *)(bp) + 4) = link_off(p))
+#define MAX_COMPACT_HEAP ((size_t)1 << 35)
+#else
+#define LEFT(bp) (*(char **)(bp))
+#define RIGHT(bp) (*(char **)((char *)(bp) + WSIZE))
+#define SET_LEFT(bp, p) (LEFT(bp) = (p))
+#define SET_RIGHT(bp, p) (RIGHT(bp) = (p))
+#endif
+#define IS_RED(bp) ((bp) != NULL && (GET(HDRP(bp)) & RED))
+#define SET_RED(bp) PUT(HDRP(bp), GET(HDRP(bp)) | RED)
+#define SET_BLACK(bp) PUT(HDRP(bp), GET(HDRP(bp)) & ~RED)
+#define FLIP_COLOR(bp) PUT(HDRP(bp), GET(HDRP(bp)) ^ RED)
+#define COPY_COLOR(dst, src) \
+    PUT(HDRP(dst), (GET(HDRP(dst)) & ~RED) | (GET(HDRP(src)) & RED))
+// 크기가 같으면 주소가 낮은 블록이 앞
+#define KEY_LESS(a, b) (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+    (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (char *)(a) < (char *)(b)))
+
+// realloc 으로 커진 적 있는 allocated 블록은 header 의 0x4 bit 로 표시
+// (free 블록에서는 같은 bit 를 RED 로 사용)
+// 표시된 블록이 다시 커지면 요청의 절반만큼 여유를 더 줘서 복사 횟수를 줄임
+// 여유는 heap 크기의 1/2^MM_GROW_SHIFT 까지만 줘서 util 이 떨어지는 폭을 묶어 둠 (-D 로 변경 가능)
+#define GROWN 0x4
+#define IS_GROWN(bp) (GET(HDRP(bp)) & GROWN)
+#define SET_GROWN(bp) PUT(HDRP(bp), GET(HDRP(bp)) | GROWN)
+#define CLR_GROWN(bp) PUT(HDRP(bp), GET(HDRP(bp)) & ~GROWN)
+#define GROW_SIZE(asize) (((asize) + ((asize) >> 1) + (BLK_ALIGN - 1)) & ~(BLK_ALIGN - 1))
+#ifndef MM_GROW_SHIFT
+#define MM_GROW_SHIFT 4
+#endif
+
+// mapping 된 블록은 mapping 시작에서 DSIZE 뒤에 payload 가 있고 header 에 mapping 크기를 둠
+// heap 바깥 주소인지로 구분하므로 heap_lock 을 잡은 상태에서 확인
+#define MMAP_OFFSET DSIZE
+#define IS_MMAPPED(bp) ((char *)(bp) < (char *)mem_heap_lo() || (char *)(bp) > (char *)mem_heap_hi())
+
+#if MM_DEFER
+// quick list 는 QUICK_MAX 이하 블록을 크기별로 모으고, 블록은 allocated 상태 그대로 둠
+#define QUICK_MAX (1<<10)
+#define QUICK_BINS ((QUICK_MAX - MIN_BLOCK) / BLK_ALIGN + 1)
+#define QUICK_IDX(size) (((size) - MIN_BLOCK) / BLK_ALIGN)
+#define QNEXT(bp) (*(char **)(bp))
+#endif
+
+#if MM_SLAB
+// 작은 요청용 slab
+// - SLAB_MAX 이하 요청은 DSIZE 단위 class 로 나누고 class 마다 slab 을 원형 목록으로 관리
+// - slab 은 heap 시작 기준 SLAB_SIZE 정렬 위치에 allocated 블록 하나로 잡은 page
+//   맨 앞에 slab_t, 나머지는 같은 크기 object (마지막 WSIZE 는 다음 블록 header)
+// - object 가 slab 에 있는지는 heap 시작부터의 page 번호로 slab_page 를 보고 판단
+// - 빈 object 가 있는 slab 이 목록 앞쪽에 오도록 유지해서 맨 앞 slab 만 보면 됨
+#define SLAB_SHIFT 12
+#define SLAB_SIZE (1 << SLAB_SHIFT)
+#define SLAB_MAX 256
+#define SLAB_CLASSES (SLAB_MAX / DSIZE)
+#define SLAB_CLASS(size) (((size) - 1) / DSIZE)
+#define SLAB_OBJ_SIZE(cls) (((cls) + 1) * DSIZE)
+// slab 은 heap 앞쪽 SLAB_MAX_PAGES 개 page 안에서만 만듦 (256MB)
+#define SLAB_MAX_PAGES (1 << 16)
+#define SLAB_HDR ((sizeof(slab_t) + (DSIZE - 1)) & ~(DSIZE - 1))
+#define SLAB_END(s) ((char *)(s) + SLAB_SIZE - WSIZE)
+#define SLAB_OF(bp) ((slab_t *)((char *)mem_heap_lo() + \
+    ((((char *)(bp) - (char *)mem_heap_lo()) >> SLAB_SHIFT) << SLAB_SHIFT)))
+#define SLAB_FULL(s) ((s)->free == NULL && (s)->bump + SLAB_OBJ_SIZE((s)->cls) > SLAB_END(s))
+#define ONEXT(p) (*(char **)(p))
+#define IS_SLAB(bp) is_slab(bp)
+#else
+#define IS_SLAB(bp) 0
+#endif
+
+#if MM_CONCURRENT
+// 스레드별 캐시
+// - TCACHE_MAX 이하 크기의 블록은 free 해도 allocated 상태 그대로 스레드 캐시에 보관
+// - 같은 크기의 malloc 은 lock 없이 캐시에서 바로 꺼내 씀
+// - 캐시가 비었거나 가득 찼을 때만 heap_lock 을 잡고 공유 free list 를 사용
+#define TCACHE_MAX (1<<9)
+#define TCACHE_BINS ((TCACHE_MAX - MIN_BLOCK) / BLK_ALIGN + 1)
+#define TCACHE_COUNT 32
+#define TCACHE_IDX(size) (((size) - MIN_BLOCK) / BLK_ALIGN)
+#define TNEXT(bp) (*(char **)(bp))
+
+typedef struct {
+    unsigned epoch;             // 캐시를 채울 때의 heap_epoch
+    int registered;             // 스레드 종료 시 flush 하도록 등록했는지
+    int count[TCACHE_BINS];
+    char *head[TCACHE_BINS];
+#if MM_SLAB
+    struct slab *slabs[SLAB_CLASSES];   // 이 스레드가 만든 slab
+    int remote[SLAB_CLASSES];           // 다른 스레드가 이 스레드의 slab 에 free 했는지
+#endif
+} tcache_t;
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+// mm_init 으로 힙이 초기화될 때마다 증가, 이전 힙을 가리키는 캐시는 버림
+static unsigned heap_epoch;
+static __thread tcache_t tcache;
+
+#define LOCK() pthread_mutex_lock(&heap_lock)
+#define UNLOCK() pthread_mutex_unlock(&heap_lock)
 
-static char *free_listp;
+static tcache_t *get_tcache(void);
+static void tcache_flush(void *arg);
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+#if MM_SLAB
+typedef struct slab {
+    struct slab *next;
+    struct slab *prev;
+    char *free;                 // free 된 object 의 intrusive list
+    char *bump;                 // 아직 한 번도 쓰지 않은 object 의 시작
+    int cls;
+    int used;                   // 사용 중인 object 수 (remote 에 있는 것 포함)
+#if MM_CONCURRENT
+    tcache_t *owner;            // slab 을 만든 스레드의 캐시, 스레드가 끝나면 NULL
+    char *remote;               // 다른 스레드가 free 한 object, heap_lock 으로 보호
+#endif
+} slab_t;
+
+static unsigned char slab_page[SLAB_MAX_PAGES];
+// slab_page 에서 지금까지 쓴 범위, mm_init 에서 여기까지만 지움
+static size_t slab_pages;
+#if !MM_CONCURRENT
+static slab_t *slab_lists[SLAB_CLASSES];
+#endif
+
+static int is_slab(void *bp);
+static void *slab_alloc(int cls);
+static void slab_free(void *bp);
+#endif
+
+static char *heap_listp;
+static char *free_root;
+#if MM_COMPACT
+static char *heap_base;             // tree 링크 offset 의 기준, mem_heap_lo()
+
+static inline unsigned int link_off(char *p) {
+    return p == NULL ? 0 : (unsigned int)((p - heap_base) >> 3);
+}
+
+static inline char *link_ptr(unsigned int off) {
+    return off == 0 ? NULL : heap_base + ((size_t)off << 3);
+}
+#endif
+#if MM_DEFER
+static char *quick_head[QUICK_BINS];
+static int quick_count;             // quick list 에 있는 블록 수
+
+static void quick_push(void *bp);
+static void *quick_pop(size_t asize);
+static void quick_sweep(void);
+static int quick_remove(void *bp);
+#endif
 static void *extend_heap(size_t words);
+static void *grow_heap(size_t incr);
 static void *coalesce(void *bp);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
+static size_t adjust_size(size_t size);
+static void trim_heap(void *bp);
+static void *map_block(size_t size);
+static void *remap_block(void *bp, size_t size);
+static void *realloc_in_place(void *bp, size_t asize);
+static int next_fits(void *bp, size_t asize);
+static int at_heap_tail(void *bp);
+static size_t grow_size(size_t asize);
+static void *grow_target(size_t asize);
+static void split_block(void *bp, size_t asize);
 
 static void connect(void *bp);
 static void disconnect(void *bp);
+static void free_block(void *bp);
+
+static char *tree_insert(char *h, char *bp);
+static char *tree_delete(char *h, char *bp);
+static char *tree_delete_min(char *h);
 
 int mm_init(void)
 {
-    if ((free_listp = mem_sbrk(6 * WSIZE)) == (void *)-1)
+#if MM_CONCURRENT
+    __atomic_add_fetch(&heap_epoch, 1, __ATOMIC_RELEASE);
+#endif
+    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
         return -1;
-    PUT(free_listp, 0);
-    PUT(free_listp + (1 * WSIZE), PACK(2 * DSIZE, 1)); 
-    // predecessor, successor
-    PUT(free_listp + (2 * WSIZE), (unsigned int)NULL);
-    PUT(free_listp + (3 * WSIZE), (unsigned int)NULL);
-    PUT(free_listp + (4 * WSIZE), PACK(2 * DSIZE, 1)); 
-    PUT(free_listp + (5 * WSIZE), PACK(0, 1)); 
-    free_listp += (2 * WSIZE);
+#if MM_COMPACT
+    heap_base = mem_heap_lo();
+#endif
+    PUT(heap_listp, 0);
+    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1 | PREV_ALLOC)); 
+    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); 
+    PUT(heap_listp + (3 * WSIZE), PACK(0, 1 | PREV_ALLOC)); 
+    heap_listp += (2 * WSIZE);
+    free_root = NULL;
+#if MM_DEFER
+    memset(quick_head, 0, sizeof(quick_head));
+    quick_count = 0;
+#endif
+#if MM_SLAB
+    memset(slab_page, 0, slab_pages);
+    slab_pages = 0;
+#if !MM_CONCURRENT
+    memset(slab_lists, 0, sizeof(slab_lists));
+#endif
+#endif
 
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
         return -1;
@@ -116,29 +380,125 @@ void *mm_malloc(size_t size)
     if (size == 0) 
         return NULL;
 
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
-    
+#if MM_SLAB
+    if (size <= SLAB_MAX && (bp = slab_alloc(SLAB_CLASS(size))) != NULL)
+        return bp;
+#endif
+
+    if (size >= MM_MMAP_THRESHOLD) {
+        LOCK();
+        bp = map_block(size);
+        UNLOCK();
+        return bp;
+    }
+
+    asize = adjust_size(size);
+
+#if MM_CONCURRENT
+    // fast path: 같은 크기 블록이 캐시에 있으면 lock 없이 반환
+    if (asize <= TCACHE_MAX) {
+        tcache_t *tc = get_tcache();
+        int idx = TCACHE_IDX(asize);
+        if ((bp = tc->head[idx]) != NULL) {
+            tc->head[idx] = TNEXT(bp);
+            tc->count[idx]--;
+            return bp;
+        }
+    }
+#endif
+
+    LOCK();
+#if MM_DEFER
+    if (asize <= QUICK_MAX && (bp = quick_pop(asize)) != NULL) {
+        UNLOCK();
+        return bp;
+    }
+#endif
     if ((bp = find_fit(asize)) != NULL) {
         place(bp, asize);
+        UNLOCK();
         return bp;
     }
 
+#if MM_DEFER
+    // 미뤄 둔 블록을 병합한 뒤 한 번 더 찾아봄
+    if (quick_count > 0) {
+        quick_sweep();
+        if ((bp = find_fit(asize)) != NULL) {
+            place(bp, asize);
+            UNLOCK();
+            return bp;
+        }
+    }
+#endif
+
     extendsize = MAX(asize, CHUNKSIZE);
-    if((bp = extend_heap(extendsize / WSIZE)) == NULL)
+    if((bp = extend_heap(extendsize / WSIZE)) == NULL) {
+        UNLOCK();
         return NULL;
+    }
     place(bp, asize);
+    UNLOCK();
     return bp;
 }
 
 void mm_free(void *bp)
+{
+#if MM_SLAB
+    if (is_slab(bp)) {
+        slab_free(bp);
+        return;
+    }
+#endif
+#if MM_CONCURRENT
+    size_t hdr = OWN_HDR(bp);
+    size_t size = hdr & ~0x7;
+
+    // fast path: 캐시에 자리가 있으면 allocated 상태 그대로 보관
+    // GROWN 표시는 lock 없이 지울 수 없으므로 표시된 블록은 lock 을 잡고 free 함
+    if (size <= TCACHE_MAX && !(hdr & GROWN)) {
+        tcache_t *tc = get_tcache();
+        int idx = TCACHE_IDX(size);
+        if (tc->count[idx] < TCACHE_COUNT) {
+            TNEXT(bp) = tc->head[idx];
+            tc->head[idx] = bp;
+            tc->count[idx]++;
+            return;
+        }
+    }
+#endif
+    LOCK();
+    if (IS_MMAPPED(bp))
+        mem_unmap((char *)bp - MMAP_OFFSET);
+#if MM_DEFER
+    else if (GET_SIZE(HDRP(bp)) <= QUICK_MAX)
+        quick_push(bp);
+#endif
+    else
+        free_block(bp);
+    UNLOCK();
+}
+
+// 블록을 free 로 표시하고 병합, heap_lock 을 잡은 상태에서 호출
+static void free_block(void *bp)
 {
     size_t size = GET_SIZE(HDRP(bp));
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    bp = coalesce(bp);
+
+    // 병합된 블록이 heap 의 마지막 블록이고 충분히 크면 heap 을 줄임
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 && GET_SIZE(HDRP(bp)) >= MM_TRIM_THRESHOLD)
+        trim_heap(bp);
+}
+
+// header 와 payload 를 담고, free 가 되었을 때 tree 노드와 footer 를 담을 수 있는 크기
+static size_t adjust_size(size_t size)
+{
+    if (size <= MIN_BLOCK - WSIZE)
+        return MIN_BLOCK;
+    return BLK_ALIGN * ((size + (WSIZE) + (BLK_ALIGN - 1)) / BLK_ALIGN);
 }
 
 void *mm_realloc(void *ptr, size_t size) {
@@ -151,52 +511,301 @@ void *mm_realloc(void *ptr, size_t size) {
         return mm_malloc(size); 
     }
 
-    size_t old_size = GET_SIZE(HDRP(ptr));
-    size_t new_size = ALIGN(size + DSIZE);
+#if MM_SLAB
+    // slab object 는 class 크기 안이면 그대로, 아니면 옮김
+    if (is_slab(ptr)) {
+        size_t obj_size = SLAB_OBJ_SIZE(SLAB_OF(ptr)->cls);
+        void *newptr;
 
-    if (new_size <= old_size) {
-        return ptr;
+        if (size <= obj_size)
+            return ptr;
+        if ((newptr = mm_malloc(size)) == NULL)
+            return NULL;
+        memcpy(newptr, ptr, obj_size);
+        mm_free(ptr);
+        return newptr;
     }
+#endif
 
+    size_t old_size;
+    size_t new_size = adjust_size(size);
+    size_t copy_size;
+    int grown = 0;
+    int again = 0;
+    void *newptr = NULL;
 
-    void *next_bp = HDRP(NEXT_BLKP(ptr));
-    if (!GET_ALLOC(next_bp) && (old_size + GET_SIZE(next_bp) >= new_size)) {
-        size_t combined_size = old_size + GET_SIZE(next_bp);
-        disconnect(NEXT_BLKP(ptr));
-        PUT(HDRP(ptr), PACK(combined_size, 1));
-        PUT(FTRP(ptr), PACK(combined_size, 1));
-        return ptr;
+    LOCK();
+    if (IS_MMAPPED(ptr)) {
+        // 여전히 큰 블록이면 mapping 크기만 바꾸고, 작아졌으면 heap 으로 옮김
+        if (size >= MM_MMAP_THRESHOLD) {
+            newptr = remap_block(ptr, size);
+            UNLOCK();
+            return newptr;
+        }
+        UNLOCK();
+        copy_size = size;
+    } else {
+        // 다른 thread 가 PREV_ALLOC bit 를 바꿀 수 있으므로 header 는 lock 을 잡고 읽음
+        old_size = GET_SIZE(HDRP(ptr));
+        grown = new_size > old_size;
+        again = grown && IS_GROWN(ptr);
+        if (IS_GROWN(ptr)) {
+            // 이전에 준 여유 안에서 다시 쓰이면 그대로 두고, 다시 커지면 또 여유를 줌
+            if (!grown && old_size <= GROW_SIZE(new_size)) {
+                UNLOCK();
+                return ptr;
+            }
+            // 제자리에서는 뒤 free 블록을 흡수해서 채울 수 있을 때만 여유를 줌
+            // heap 끝은 복사 없이 늘릴 수 있으므로 여유를 주면 util 만 떨어지고,
+            // 앞 블록으로 당기면서 여유를 주면 다음 realloc 때 다시 당겨지며 오가게 됨
+            if (again && next_fits(ptr, grow_size(new_size)) &&
+                (newptr = realloc_in_place(ptr, grow_size(new_size))) != NULL) {
+                SET_GROWN(newptr);
+                UNLOCK();
+                return newptr;
+            }
+        }
+        // 큰 블록으로 자라는 경우는 heap 에서 늘리지 않고 mapping 으로 옮김
+        if (!grown || size < MM_MMAP_THRESHOLD) {
+            if ((newptr = realloc_in_place(ptr, new_size)) != NULL) {
+                // 줄어든 블록은 남는 부분을 돌려받았으므로 표시를 지움
+                if (grown)
+                    SET_GROWN(newptr);
+                else
+                    CLR_GROWN(newptr);
+                UNLOCK();
+                return newptr;
+            }
+        }
+        // 다시 커지는 블록은 옮길 때도 여유를 줘서 다음 realloc 이 복사 없이 끝나게 함
+        newptr = again && size < MM_MMAP_THRESHOLD ? grow_target(new_size) : NULL;
+        UNLOCK();
+        copy_size = old_size - WSIZE;
     }
 
-    void *newptr = mm_malloc(size);
-    if (newptr == NULL) {
+    if (newptr == NULL && (newptr = mm_malloc(size)) == NULL) {
         return NULL;
     }
 
-    memcpy(newptr, ptr, old_size - DSIZE);
+    memcpy(newptr, ptr, copy_size);
     mm_free(ptr);
 
+    // 복사해서 옮긴 블록도 커진 블록으로 표시 (header 가 없는 slab object 는 제외)
+    if (grown) {
+        LOCK();
+        if (!IS_MMAPPED(newptr) && !IS_SLAB(newptr))
+            SET_GROWN(newptr);
+        UNLOCK();
+    }
+
     return newptr;
 }
 
+// 새 블록을 받아 복사하지 않고 제자리에서 (또는 앞 free 블록으로 당겨서) 크기를 맞춤
+// 안 되면 NULL, heap_lock 을 잡은 상태에서 호출
+static void *realloc_in_place(void *bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t prev_size = prev_alloc ? 0 : GET_SIZE(HDRP(bp) - WSIZE);
+    char *next = NEXT_BLKP(bp);
+    size_t next_size;
+    char *newbp;
+
+    // 줄어들면 남는 부분만 떼어서 돌려줌
+    if (asize <= size) {
+        split_block(bp, asize);
+        return bp;
+    }
+
+#if MM_DEFER
+    // 다음 블록이 quick list 에 미뤄 둔 블록이면 꺼내서 free 로 돌려놓고 흡수할 수 있게 함
+    if (GET_ALLOC(HDRP(next)) && quick_remove(next))
+        free_block(next);
+#endif
+    next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+
+    // 다음 free 블록을 흡수
+    if (size + next_size >= asize) {
+        disconnect(next);
+        PUT(HDRP(bp), PACK(size + next_size, 1 | prev_alloc));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+        split_block(bp, asize);
+        return bp;
+    }
+
+    // heap 의 마지막 블록이면 (뒤의 free 블록을 포함해) 모자란 만큼만 heap 을 늘림
+    // 복사가 없으므로 앞 블록으로 옮기는 것보다 먼저 시도
+    if (GET_SIZE(HDRP(next_size ? NEXT_BLKP(next) : next)) == 0) {
+        if (grow_heap(asize - size - next_size) == (void *)-1)
+            return NULL;
+        if (next_size)
+            disconnect(next);
+        PUT(HDRP(bp), PACK(asize, 1 | prev_alloc));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1 | PREV_ALLOC));
+        return bp;
+    }
+    // 앞 free 블록까지 합쳐서 충분하면 payload 를 앞으로 옮김
+    if (prev_size + size + next_size >= asize) {
+        newbp = (char *)bp - prev_size;
+        disconnect(newbp);
+        if (next_size)
+            disconnect(next);
+        memmove(newbp, bp, size - WSIZE);
+        // free 블록 앞은 항상 allocated 블록
+        PUT(HDRP(newbp), PACK(prev_size + size + next_size, 1 | PREV_ALLOC));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(newbp)));
+        split_block(newbp, asize);
+        return newbp;
+    }
+
+    return NULL;
+}
+
+// 뒤 free 블록까지 합치면 asize 가 되는지, heap_lock 을 잡은 상태에서 호출
+static int next_fits(void *bp, size_t asize)
+{
+    char *next = NEXT_BLKP(bp);
+
+    return !GET_ALLOC(HDRP(next)) &&
+        GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(next)) >= asize;
+}
+
+// heap 의 마지막 블록인지 (뒤에 free 블록 하나만 있어도), heap_lock 을 잡은 상태에서 호출
+static int at_heap_tail(void *bp)
+{
+    char *next = NEXT_BLKP(bp);
+
+    if (!GET_ALLOC(HDRP(next)))
+        next = NEXT_BLKP(next);
+    return GET_SIZE(HDRP(next)) == 0;
+}
+
+// 다시 커지는 블록에 줄 크기, 여유는 요청의 절반과 heap 크기의 1/2^MM_GROW_SHIFT 중 작은 쪽
+static size_t grow_size(size_t asize)
+{
+    size_t room = MIN(asize >> 1, mem_heapsize() >> MM_GROW_SHIFT);
+
+    return (asize + room) & ~(size_t)(BLK_ALIGN - 1);
+}
+
+// 다시 커지는 블록을 옮길 allocated 블록을 받음, 안 되면 NULL, heap_lock 을 잡은 상태에서 호출
+// heap 끝에 자리를 잡으면 뒤에 남은 free 블록까지 다 써서 작은 블록이 바로 뒤에 끼어들지 못하게 함
+// (그러면 다음부터는 복사 없이 heap 끝을 늘릴 수 있음)
+static void *grow_target(size_t asize)
+{
+    size_t gsize = grow_size(asize);
+    char *bp;
+
+    // 요청한 크기로 heap 끝 free 블록에 들어가면 heap 을 늘리지 않고 그 블록을 씀
+    if ((bp = find_fit(asize)) == NULL || !at_heap_tail(bp)) {
+        if ((bp = find_fit(gsize)) == NULL &&
+            (bp = extend_heap(MAX(gsize, CHUNKSIZE) / WSIZE)) == NULL)
+            return NULL;
+        place(bp, gsize);
+    } else
+        place(bp, asize);
+    if (at_heap_tail(bp) && !GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+        bp = realloc_in_place(bp, GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(NEXT_BLKP(bp))));
+    return bp;
+}
+
+// allocated 블록을 asize 로 줄이고 남는 부분이 블록이 될 만큼 크면 free 로 돌려줌
+static void split_block(void *bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *rest;
+
+    if (size - asize < MIN_BLOCK)
+        return;
+    PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(size - asize, 1 | PREV_ALLOC));
+    free_block(rest);
+}
+
 static void *extend_heap(size_t words) 
 {
     char *bp;
     size_t size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
 
-    if ((long)(bp = mem_sbrk(size)) == -1)
+    if ((bp = grow_heap(size)) == (void *)-1)
         return NULL;
     
-    PUT(HDRP(bp), PACK(size, 0));
+    // 이전 epilogue header 에 마지막 블록의 allocated 여부가 남아 있음
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, 0));
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
 
     return coalesce(bp);
 }
 
+// mem_sbrk 로 heap 을 늘림, MM_COMPACT 에서는 offset 으로 가리킬 수 있는 범위까지만
+static void *grow_heap(size_t incr)
+{
+#if MM_COMPACT
+    if (mem_heapsize() + incr > MAX_COMPACT_HEAP)
+        return (void *)-1;
+#endif
+    if (incr > INT_MAX)
+        return (void *)-1;
+    return mem_sbrk((int)incr);
+}
+
+// heap 의 마지막 free 블록에서 TRIM_PAD 만 남기고 돌려주고 그 뒤에 epilogue 를 둠
+static void trim_heap(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size <= TRIM_PAD || size - TRIM_PAD > INT_MAX)
+        return;
+    disconnect(bp);
+    if (mem_sbrk(-(int)(size - TRIM_PAD)) == (void *)-1) {
+        connect(bp);
+        return;
+    }
+    PUT(HDRP(bp), PACK(TRIM_PAD, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(TRIM_PAD, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    connect(bp);
+}
+
+// size 바이트 payload 를 담을 mapping 을 따로 받아 allocated 블록으로 만듦
+static void *map_block(size_t size)
+{
+    size_t msize = size + MMAP_OFFSET;
+    char *p;
+
+    // page 단위로 올리다 넘치는 크기는 실패
+    if (msize < size || msize > (size_t)-1 - mem_pagesize())
+        return NULL;
+    if ((p = mem_map(msize)) == (void *)-1)
+        return NULL;
+    msize = (msize + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    PUT(p + WSIZE, PACK(msize, 1));
+    return p + MMAP_OFFSET;
+}
+
+// mapping 된 블록을 mremap 으로 늘리거나 줄임, 필요하면 주소가 바뀜
+static void *remap_block(void *bp, size_t size)
+{
+    size_t msize = size + MMAP_OFFSET;
+    char *p;
+
+    if (msize < size || msize > (size_t)-1 - mem_pagesize())
+        return NULL;
+    msize = (msize + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    if (msize == GET_SIZE(HDRP(bp)))
+        return bp;
+    if ((p = mem_remap((char *)bp - MMAP_OFFSET, msize)) == (void *)-1)
+        return NULL;
+    PUT(p + WSIZE, PACK(msize, 1));
+    return p + MMAP_OFFSET;
+}
+
 static void *coalesce(void *bp) 
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
@@ -210,7 +819,7 @@ static void *coalesce(void *bp)
     else if (prev_alloc && !next_alloc) {
         disconnect(NEXT_BLKP(bp)); // @
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
         PUT(FTRP(bp), PACK(size, 0));
     }
 
@@ -219,8 +828,8 @@ static void *coalesce(void *bp)
         disconnect(PREV_BLKP(bp)); // @
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         bp = PREV_BLKP(bp);
-        PUT(HDRP(bp), PACK(size,0));
-        PUT(FTRP(bp), PACK(size,0));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, 0));
     }
 
     // case 4
@@ -229,7 +838,7 @@ static void *coalesce(void *bp)
         disconnect(NEXT_BLKP(bp)); // @
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
         bp = PREV_BLKP(bp);
-        PUT(HDRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
         PUT(FTRP(bp), PACK(size, 0));
     }
     connect(bp); // @
@@ -240,7 +849,7 @@ static void *coalesce(void *bp)
 // static void *first_fit(size_t asize) {
 //     void *bp;
     
-//     for(bp = free_listp; GET_SIZE(HDRP(bp)); bp = NEXT_BLKP(bp)) {
+//     for(bp = heap_listp; GET_SIZE(HDRP(bp)); bp = NEXT_BLKP(bp)) {
 //         if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize) {
 //             return bp;
 //         }
@@ -248,23 +857,20 @@ static void *coalesce(void *bp)
 //     return NULL;
 // }
 
+// asize 이상인 블록 중 가장 작은 블록 (크기가 같으면 주소가 가장 낮은 블록)
 static void *best_fit(size_t asize) {
-    void *bp = free_listp;
-    void *min_size_bp = NULL;
-    size_t min_size = (size_t) - 1;
+    char *bp = free_root;
+    char *fit = NULL;
 
-    while (GET_ALLOC(HDRP(bp)) != 1) {
-        if (GET_SIZE(HDRP(bp)) == asize) {
-            return bp;
+    while (bp != NULL) {
+        if (GET_SIZE(HDRP(bp)) >= asize) {
+            fit = bp;
+            bp = LEFT(bp);
+        } else {
+            bp = RIGHT(bp);
         }
-        if (GET_SIZE(HDRP(bp)) > asize && GET_SIZE(HDRP(bp)) < min_size) {
-            min_size = GET_SIZE(HDRP(bp));
-            min_size_bp = bp;
-        }
-        bp = SUCC(bp);
     }
-    
-    return min_size_bp;
+    return fit;
 }
 
 static void *find_fit(size_t asize) {
@@ -276,34 +882,537 @@ static void place(void *bp, size_t asize) {
     size_t csize = GET_SIZE(HDRP(bp));
     
     disconnect(bp); // @
-    if ((csize - asize) >= (2 * DSIZE)) {
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+    if ((csize - asize) >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(asize, 1 | PREV_ALLOC));
         bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize - asize, 0));
+        PUT(HDRP(bp), PACK(csize - asize, PREV_ALLOC));
         PUT(FTRP(bp), PACK(csize - asize, 0));
         connect(bp); // @
     } else {
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
+        PUT(HDRP(bp), PACK(csize, 1 | PREV_ALLOC));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
 }
 
-// PREDECESSOR, SUCCESSOR 포인터 연결
+// free 블록을 tree 에 추가
 static void connect(void *bp) {
-    SUCC(bp) = free_listp;
-    PRED(bp) = NULL;
-    PRED(free_listp) = bp; 
-    free_listp = bp;
+    free_root = tree_insert(free_root, bp);
+    SET_BLACK(free_root);
 }
 
-// PREDECESSOR, SUCCESSOR 포인터 연결 해제
+// free 블록을 tree 에서 제거
 static void disconnect(void *bp) {
-    if(bp == free_listp) {
-        PRED(SUCC(bp)) = NULL;
-        free_listp = SUCC(bp);
+    if (!IS_RED(LEFT(free_root)) && !IS_RED(RIGHT(free_root)))
+        SET_RED(free_root);
+    free_root = tree_delete(free_root, bp);
+    if (free_root != NULL)
+        SET_BLACK(free_root);
+}
+
+static char *rotate_left(char *h) {
+    char *x = RIGHT(h);
+    SET_RIGHT(h, LEFT(x));
+    SET_LEFT(x, h);
+    COPY_COLOR(x, h);
+    SET_RED(h);
+    return x;
+}
+
+static char *rotate_right(char *h) {
+    char *x = LEFT(h);
+    SET_LEFT(h, RIGHT(x));
+    SET_RIGHT(x, h);
+    COPY_COLOR(x, h);
+    SET_RED(h);
+    return x;
+}
+
+static void flip_colors(char *h) {
+    FLIP_COLOR(h);
+    FLIP_COLOR(LEFT(h));
+    FLIP_COLOR(RIGHT(h));
+}
+
+// 올라오면서 오른쪽으로 기운 red 링크, 연속된 red 링크, 4-node 를 정리
+static char *fix_up(char *h) {
+    if (IS_RED(RIGHT(h)) && !IS_RED(LEFT(h)))
+        h = rotate_left(h);
+    if (IS_RED(LEFT(h)) && IS_RED(LEFT(LEFT(h))))
+        h = rotate_right(h);
+    if (IS_RED(LEFT(h)) && IS_RED(RIGHT(h)))
+        flip_colors(h);
+    return h;
+}
+
+static char *move_red_left(char *h) {
+    flip_colors(h);
+    if (IS_RED(LEFT(RIGHT(h)))) {
+        SET_RIGHT(h, rotate_right(RIGHT(h)));
+        h = rotate_left(h);
+        flip_colors(h);
+    }
+    return h;
+}
+
+static char *move_red_right(char *h) {
+    flip_colors(h);
+    if (IS_RED(LEFT(LEFT(h)))) {
+        h = rotate_right(h);
+        flip_colors(h);
+    }
+    return h;
+}
+
+static char *tree_insert(char *h, char *bp) {
+    if (h == NULL) {
+        SET_LEFT(bp, NULL);
+        SET_RIGHT(bp, NULL);
+        SET_RED(bp);
+        return bp;
+    }
+    if (KEY_LESS(bp, h))
+        SET_LEFT(h, tree_insert(LEFT(h), bp));
+    else
+        SET_RIGHT(h, tree_insert(RIGHT(h), bp));
+    return fix_up(h);
+}
+
+static char *tree_delete_min(char *h) {
+    if (LEFT(h) == NULL)
+        return NULL;
+    if (!IS_RED(LEFT(h)) && !IS_RED(LEFT(LEFT(h))))
+        h = move_red_left(h);
+    SET_LEFT(h, tree_delete_min(LEFT(h)));
+    return fix_up(h);
+}
+
+// bp 는 반드시 tree 안에 있어야 함
+static char *tree_delete(char *h, char *bp) {
+    char *min, *right;
+
+    if (KEY_LESS(bp, h)) {
+        if (!IS_RED(LEFT(h)) && !IS_RED(LEFT(LEFT(h))))
+            h = move_red_left(h);
+        SET_LEFT(h, tree_delete(LEFT(h), bp));
+    } else {
+        if (IS_RED(LEFT(h)))
+            h = rotate_right(h);
+        if (h == bp && RIGHT(h) == NULL)
+            return NULL;
+        if (!IS_RED(RIGHT(h)) && !IS_RED(LEFT(RIGHT(h))))
+            h = move_red_right(h);
+        if (h == bp) {
+            // 오른쪽 subtree 의 최소 블록을 h 자리에 옮겨 붙임
+            for (min = RIGHT(h); LEFT(min) != NULL; min = LEFT(min))
+                ;
+            right = tree_delete_min(RIGHT(h));
+            SET_LEFT(min, LEFT(h));
+            SET_RIGHT(min, right);
+            COPY_COLOR(min, h);
+            h = min;
+        } else {
+            SET_RIGHT(h, tree_delete(RIGHT(h), bp));
+        }
+    }
+    return fix_up(h);
+}
+
+#if MM_DEFER
+// 아래 함수들은 heap_lock 을 잡은 상태에서 호출
+
+// 병합하지 않고 크기가 같은 블록끼리 모아 둠, 너무 많이 쌓이면 모두 병합
+static void quick_push(void *bp) {
+    int idx = QUICK_IDX(GET_SIZE(HDRP(bp)));
+
+    QNEXT(bp) = quick_head[idx];
+    quick_head[idx] = bp;
+    if (++quick_count >= MM_DEFER_LIMIT)
+        quick_sweep();
+}
+
+// 크기가 정확히 asize 인 블록을 꺼냄, 이전 주인이 남긴 GROWN 표시는 지움
+static void *quick_pop(size_t asize) {
+    int idx = QUICK_IDX(asize);
+    char *bp;
+
+    if ((bp = quick_head[idx]) == NULL)
+        return NULL;
+    quick_head[idx] = QNEXT(bp);
+    quick_count--;
+    CLR_GROWN(bp);
+    return bp;
+}
+
+// bp 가 quick list 에 있으면 빼고 1, 없으면 0
+// bin 하나는 MM_DEFER_LIMIT 개를 넘지 않으므로 훑어서 찾음
+static int quick_remove(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    char **pp;
+
+    // epilogue (크기 0) 나 QUICK_MAX 보다 큰 블록은 quick list 에 없음
+    if (size < MIN_BLOCK || size > QUICK_MAX)
+        return 0;
+    for (pp = &quick_head[QUICK_IDX(size)]; *pp != NULL; pp = &QNEXT(*pp)) {
+        if (*pp == bp) {
+            *pp = QNEXT(bp);
+            quick_count--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 미뤄 둔 블록을 모두 free 로 만들고 병합
+static void quick_sweep(void) {
+    char *bp;
+    int i;
+
+    for (i = 0; i < QUICK_BINS; i++) {
+        while ((bp = quick_head[i]) != NULL) {
+            quick_head[i] = QNEXT(bp);
+            free_block(bp);
+        }
+    }
+    quick_count = 0;
+}
+#endif
+
+#if MM_SLAB
+#if MM_CONCURRENT
+#define SLAB_LISTS() (get_tcache()->slabs)
+#else
+#define SLAB_LISTS() (slab_lists)
+#endif
+
+static slab_t *slab_create(int cls);
+static void slab_release(slab_t *s);
+static void *best_fit(size_t asize);
+
+// bp 가 slab 안의 object 인지, heap 아래의 주소는 음수가 되어 범위를 벗어남
+static int is_slab(void *bp) {
+    size_t page = (size_t)((char *)bp - (char *)mem_heap_lo()) >> SLAB_SHIFT;
+    return page < SLAB_MAX_PAGES && slab_page[page];
+}
+
+// s 를 목록 맨 앞에 넣음
+// 맨 앞 slab 이 가득 찼으면 그 slab 은 목록 끝이 되도록 다음 slab 앞에 넣음
+static void slab_push(slab_t **lists, slab_t *s) {
+    slab_t *head = lists[s->cls];
+
+    if (head != NULL && SLAB_FULL(head))
+        head = head->next;
+    if (head == NULL) {
+        s->next = s->prev = s;
+    } else {
+        s->next = head;
+        s->prev = head->prev;
+        head->prev->next = s;
+        head->prev = s;
+    }
+    lists[s->cls] = s;
+}
+
+static void slab_unlink(slab_t **lists, slab_t *s) {
+    if (s->next == s) {
+        lists[s->cls] = NULL;
+        return;
+    }
+    s->prev->next = s->next;
+    s->next->prev = s->prev;
+    if (lists[s->cls] == s)
+        lists[s->cls] = s->next;
+}
+
+#if MM_CONCURRENT
+// 다른 스레드가 free 한 object 를 slab 의 free list 로 옮김, heap_lock 을 잡은 상태에서 호출
+static void slab_collect(slab_t *s) {
+    char *p;
+
+    while ((p = s->remote) != NULL) {
+        s->remote = ONEXT(p);
+        ONEXT(p) = s->free;
+        s->free = p;
+        s->used--;
+    }
+}
+#endif
+
+// 맨 앞 slab 이 가득 찼을 때 빈 object 가 있는 slab 을 맨 앞으로 가져옴
+static slab_t *slab_refill(slab_t **lists, int cls) {
+    slab_t *s = lists[cls];
+
+    // 가득 찬 slab 은 뒤로 보냄, 다음 slab 도 가득 찼으면 모두 가득 찬 것
+    if (s != NULL && s->next != s) {
+        lists[cls] = s->next;
+        if (!SLAB_FULL(lists[cls]))
+            return lists[cls];
+    }
+
+#if MM_CONCURRENT
+    tcache_t *tc = get_tcache();
+
+    // 다른 스레드가 free 한 object 가 있으면 모아서 그 slab 을 앞으로
+    if (s != NULL && __atomic_load_n(&tc->remote[cls], __ATOMIC_ACQUIRE)) {
+        slab_t *start = lists[cls], *next;
+
+        LOCK();
+        tc->remote[cls] = 0;
+        s = start;
+        do {
+            next = s->next;
+            if (s->remote != NULL) {
+                slab_collect(s);
+                if (s != lists[cls]) {
+                    slab_unlink(lists, s);
+                    slab_push(lists, s);
+                }
+            }
+            s = next;
+        } while (s != start);
+        UNLOCK();
+        if (!SLAB_FULL(lists[cls]))
+            return lists[cls];
+    }
+#endif
+
+    LOCK();
+    s = slab_create(cls);
+    UNLOCK();
+    if (s != NULL)
+        slab_push(lists, s);
+    return s;
+}
+
+static void *slab_alloc(int cls) {
+    slab_t **lists = SLAB_LISTS();
+    slab_t *s = lists[cls];
+    char *p;
+
+    if (s == NULL || SLAB_FULL(s)) {
+        if ((s = slab_refill(lists, cls)) == NULL)
+            return NULL;
+    }
+    if ((p = s->free) != NULL) {
+        s->free = ONEXT(p);
+    } else {
+        p = s->bump;
+        s->bump += SLAB_OBJ_SIZE(cls);
+    }
+    s->used++;
+    return p;
+}
+
+static void slab_free(void *bp) {
+    slab_t *s = SLAB_OF(bp);
+    slab_t **lists;
+    int full;
+
+#if MM_CONCURRENT
+    tcache_t *tc = get_tcache();
+
+    // 다른 스레드의 slab 이면 remote 에 넣고 주인에게 알림
+    // owner 는 lock 을 잡고 바뀌지만 여기서는 lock 없이 읽으므로 atomic 으로 주고받음
+    if (__atomic_load_n(&s->owner, __ATOMIC_ACQUIRE) != tc) {
+        LOCK();
+        if (s->owner != NULL) {
+            ONEXT(bp) = s->remote;
+            s->remote = bp;
+            __atomic_store_n(&s->owner->remote[s->cls], 1, __ATOMIC_RELEASE);
+        } else {
+            // 주인 스레드가 끝난 slab 은 lock 을 잡고 직접 돌려줌
+            ONEXT(bp) = s->free;
+            s->free = bp;
+            if (--s->used == 0)
+                slab_release(s);
+        }
+        UNLOCK();
         return;
-    } 
-    SUCC(PRED(bp)) = SUCC(bp);
-    PRED(SUCC(bp)) = PRED(bp);
-}
\ No newline at end of file
+    }
+#endif
+
+    lists = SLAB_LISTS();
+    full = SLAB_FULL(s);
+    ONEXT(bp) = s->free;
+    s->free = bp;
+    s->used--;
+
+    // 다 빈 slab 은 지금 할당에 쓰는 맨 앞 slab 이 아닐 때만 heap 으로 돌려줌
+    if (s->used == 0 && lists[s->cls] != s) {
+        slab_unlink(lists, s);
+        LOCK();
+        slab_release(s);
+        UNLOCK();
+    } else if (full && lists[s->cls] != s) {
+        slab_unlink(lists, s);
+        slab_push(lists, s);
+    }
+}
+
+// heap 시작에서 off 만큼 떨어진 곳부터 다음 SLAB_SIZE 정렬 위치까지의 거리
+// 그 사이를 채우는 free 블록이 최소 블록보다 작으면 한 page 를 더 띄움
+static size_t slab_pad(size_t off) {
+    size_t pad = (SLAB_SIZE - (off & (SLAB_SIZE - 1))) & (SLAB_SIZE - 1);
+
+    if (pad != 0 && pad < MIN_BLOCK)
+        pad += SLAB_SIZE;
+    return pad;
+}
+
+// free 블록 bp 안에 정렬된 page 가 들어가면 앞뒤를 free 블록으로 남기고 slab 블록을 잘라냄
+static slab_t *slab_carve(char *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t pad = slab_pad(bp - (char *)mem_heap_lo());
+    size_t rest;
+    char *s, *r;
+
+    if (pad + SLAB_SIZE > size)
+        return NULL;
+    rest = size - pad - SLAB_SIZE;
+    if ((rest != 0 && rest < MIN_BLOCK) ||
+        ((bp + pad - (char *)mem_heap_lo()) >> SLAB_SHIFT) >= SLAB_MAX_PAGES)
+        return NULL;
+
+    // free 블록 앞은 항상 allocated 블록
+    disconnect(bp);
+    s = bp;
+    if (pad != 0) {
+        PUT(HDRP(bp), PACK(pad, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(pad, 0));
+        connect(bp);
+        s = bp + pad;
+    }
+    PUT(HDRP(s), PACK(SLAB_SIZE, 1 | (pad == 0 ? PREV_ALLOC : 0)));
+    if (rest != 0) {
+        r = NEXT_BLKP(s);
+        PUT(HDRP(r), PACK(rest, PREV_ALLOC));
+        PUT(FTRP(r), PACK(rest, 0));
+        connect(r);
+    } else {
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(s)));
+    }
+    return (slab_t *)s;
+}
+
+// SLAB_SIZE 정렬 위치에 slab 블록을 만듦, heap_lock 을 잡은 상태에서 호출
+// 비어 있는 page 크기 블록 (대개 돌려준 slab) 이나 충분히 큰 free 블록을 먼저 쓰고
+// 없으면 heap 끝을 늘림
+static slab_t *slab_create(int cls) {
+    size_t brk, pad, page;
+    char *bp;
+    slab_t *s = NULL;
+
+    if ((bp = best_fit(SLAB_SIZE)) != NULL)
+        s = slab_carve(bp);
+    if (s == NULL && (bp = best_fit(3 * SLAB_SIZE)) != NULL)
+        s = slab_carve(bp);
+    if (s == NULL) {
+        brk = mem_heapsize();
+        pad = slab_pad(brk);
+        if (((brk + pad) >> SLAB_SHIFT) >= SLAB_MAX_PAGES)
+            return NULL;
+        // extend_heap 은 짝수 word 로 올리므로 정렬 위치까지 딱 pad 만큼만 늘려 free 블록으로 둠
+        if (pad != 0) {
+            if ((bp = grow_heap(pad)) == (void *)-1)
+                return NULL;
+            PUT(HDRP(bp), PACK(pad, GET_PREV_ALLOC(HDRP(bp))));
+            PUT(FTRP(bp), PACK(pad, 0));
+            PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+            coalesce(bp);
+        }
+        if ((s = grow_heap(SLAB_SIZE)) == (void *)-1)
+            return NULL;
+        // 이전 epilogue 자리가 slab 블록의 header
+        PUT(HDRP(s), PACK(SLAB_SIZE, 1 | GET_PREV_ALLOC(HDRP(s))));
+        PUT(HDRP(NEXT_BLKP(s)), PACK(0, 1 | PREV_ALLOC));
+    }
+
+    assert((((char *)s - (char *)mem_heap_lo()) & (SLAB_SIZE - 1)) == 0);
+    page = ((char *)s - (char *)mem_heap_lo()) >> SLAB_SHIFT;
+    slab_page[page] = 1;
+    if (page >= slab_pages)
+        slab_pages = page + 1;
+
+    s->free = NULL;
+    s->bump = (char *)s + SLAB_HDR;
+    s->cls = cls;
+    s->used = 0;
+#if MM_CONCURRENT
+    __atomic_store_n(&s->owner, get_tcache(), __ATOMIC_RELEASE);
+    s->remote = NULL;
+#endif
+    return s;
+}
+
+// 빈 slab 을 일반 free 블록으로 돌려줌, heap_lock 을 잡은 상태에서 호출
+static void slab_release(slab_t *s) {
+    slab_page[((char *)s - (char *)mem_heap_lo()) >> SLAB_SHIFT] = 0;
+    free_block(s);
+}
+#endif
+
+#if MM_CONCURRENT
+static void tcache_key_init(void) {
+    pthread_key_create(&tcache_key, tcache_flush);
+}
+
+// 현재 스레드의 캐시, mm_init 이후 처음 쓰는 경우 이전 힙의 블록은 버림
+static tcache_t *get_tcache(void) {
+    tcache_t *tc = &tcache;
+    unsigned epoch = __atomic_load_n(&heap_epoch, __ATOMIC_ACQUIRE);
+
+    if (tc->epoch != epoch) {
+        memset(tc->count, 0, sizeof(tc->count));
+        memset(tc->head, 0, sizeof(tc->head));
+#if MM_SLAB
+        memset(tc->slabs, 0, sizeof(tc->slabs));
+        memset(tc->remote, 0, sizeof(tc->remote));
+#endif
+        tc->epoch = epoch;
+    }
+    if (!tc->registered) {
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+        tc->registered = 1;
+    }
+    return tc;
+}
+
+// 스레드 종료 시 캐시에 남은 블록을 공유 free list 로 돌려줌
+// 이 스레드의 slab 은 빈 것은 돌려주고 나머지는 주인 없는 slab 으로 남김
+static void tcache_flush(void *arg) {
+    tcache_t *tc = arg;
+    char *bp;
+    int i;
+#if MM_SLAB
+    slab_t *s, *next;
+#endif
+
+    if (tc->epoch != __atomic_load_n(&heap_epoch, __ATOMIC_ACQUIRE))
+        return;
+    LOCK();
+    for (i = 0; i < TCACHE_BINS; i++) {
+        while ((bp = tc->head[i]) != NULL) {
+            tc->head[i] = TNEXT(bp);
+            free_block(bp);
+        }
+        tc->count[i] = 0;
+    }
+#if MM_SLAB
+    for (i = 0; i < SLAB_CLASSES; i++) {
+        if ((s = tc->slabs[i]) == NULL)
+            continue;
+        s->prev->next = NULL;
+        for (; s != NULL; s = next) {
+            next = s->next;
+            slab_collect(s);
+            __atomic_store_n(&s->owner, NULL, __ATOMIC_RELEASE);
+            if (s->used == 0)
+                slab_release(s);
+        }
+        tc->slabs[i] = NULL;
+        tc->remote[i] = 0;
+    }
+#endif
+    UNLOCK();
+}
+#endif
@@ -0,0 +1,477 @@
+/*
+ * mmgen.c - Generate synthetic malloc workloads on the fly
+ *
+ * A workload is described by a spec of comma separated key=value
+ * pairs (numbers take a k, m, or g suffix):
+ *
+ *   ops=N               requests to issue, before the blocks that are
+ *                       still live are freed (default 1m)
+ *   size=uniform:A:B    request sizes uniform in A..B bytes
+ *   size=lognormal:M:S  log-normal with median M and log std dev S
+ *                       (default lognormal:64:1)
+ *   size=zipf:N:S       8*k bytes, where rank k in 1..N has weight k^-S
+ *   size=bimodal:A:B:P  A bytes, or B bytes with probability P
+ *   life=exp:M          block lifetimes in ops, exponential with mean M
+ *                       (default exp:10000)
+ *   life=uniform:A:B    lifetimes uniform in A..B ops
+ *   realloc=P:F         with probability P, an op resizes a random live
+ *                       block by a factor F instead (default 0:1)
+ *   live=N              before an alloc would take the live payload
+ *                       over N bytes, free the next block to die
+ *                       instead (default 0, no cap)
+ *   max=N               largest request in bytes (default 1m)
+ *   seed=N              seed of the random numbers (default 1)
+ *
+ * Each block dies a lifetime after it was allocated, at which point
+ * it is freed. The blocks are kept in a min-heap on time of death, and
+ * ids of freed blocks are handed out again, so the number of ids stays
+ * close to the largest live set rather than growing with the ops.
+ * The heap still has to hold that live set: with the default 20 MB
+ * MAX_HEAP, long lifetimes need live= or a VMHEAP=1 build.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mmgen.h"
+
+/* Size and lifetime distributions */
+#define DIST_UNIFORM   0
+#define DIST_LOGNORMAL 1
+#define DIST_ZIPF      2
+#define DIST_BIMODAL   3
+#define DIST_EXP       4
+
+#define ZIPF_ALIGN 8  /* zipf rank k asks for ZIPF_ALIGN*k bytes */
+
+/* A distribution and up to three parameters */
+typedef struct {
+    int kind;
+    double a, b, c;
+} dist_t;
+
+/* State of one id */
+typedef struct {
+    int size;   /* payload size if live */
+    long death; /* op count at which the block is freed */
+    int lpos;   /* position in the live list */
+} gen_block_t;
+
+struct mmgen {
+    /* parameters from the spec */
+    long ops;
+    dist_t size;
+    dist_t life;
+    double realloc_p, realloc_f;
+    size_t live_max;
+    int max_size;
+    unsigned long long rng;     /* xorshift64* state */
+
+    double *zipf_cdf;           /* cumulative zipf weights, if size=zipf */
+    long now;                   /* ops issued so far, final frees excluded */
+    int pending;                /* size of an alloc held back by live=, or 0 */
+
+    gen_block_t *blocks;        /* state of each id */
+    int num_ids;                /* ids handed out so far... */
+    int cap_ids;                /* ... and room for them in blocks */
+    int *free_ids;              /* ids of dead blocks, for reuse... */
+    int num_free_ids;           /* ... and their number */
+    int *heap;                  /* live ids, a min-heap on death */
+    int *live;                  /* live ids in no order, for realloc */
+    int num_live;
+
+    size_t live_bytes;          /* payload bytes live now... */
+    size_t peak_live;           /* ... and at most so far */
+};
+
+/*
+ * rnd - uniform random double in [0, 1)
+ */
+static double rnd(mmgen_t *g)
+{
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return ((g->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * normal - standard normal random number (Box-Muller)
+ */
+static double normal(mmgen_t *g)
+{
+    double u = 1.0 - rnd(g), v = rnd(g);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/*
+ * sample - draw a value from distribution d
+ */
+static double sample(mmgen_t *g, dist_t *d)
+{
+    double u;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case DIST_UNIFORM:
+	return d->a + rnd(g) * (d->b - d->a + 1);
+    case DIST_LOGNORMAL:
+	return d->a * exp(d->b * normal(g));
+    case DIST_ZIPF:
+	u = rnd(g) * g->zipf_cdf[(int)d->a - 1];
+	for (lo = 0, hi = (int)d->a - 1; lo < hi; ) {
+	    mid = (lo + hi) / 2;
+	    if (g->zipf_cdf[mid] > u)
+		hi = mid;
+	    else
+		lo = mid + 1;
+	}
+	return ZIPF_ALIGN * (lo + 1);
+    case DIST_BIMODAL:
+	return (rnd(g) < d->c) ? d->b : d->a;
+    case DIST_EXP:
+	return -d->a * log(1.0 - rnd(g));
+    }
+    return 0;
+}
+
+/*
+ * clamp_size - turn a sampled size into a request of 1..max_size bytes
+ */
+static int clamp_size(mmgen_t *g, double size)
+{
+    if (size < 1)
+	return 1;
+    if (size > g->max_size)
+	return g->max_size;
+    return (int)size;
+}
+
+/*
+ * Min-heap of live ids ordered by their time of death
+ */
+#define DEATH(i) (g->blocks[g->heap[i]].death)
+
+static void heap_swap(mmgen_t *g, int i, int j)
+{
+    int t = g->heap[i];
+
+    g->heap[i] = g->heap[j];
+    g->heap[j] = t;
+}
+
+static void heap_push(mmgen_t *g, int id)
+{
+    int i = g->num_live;
+
+    g->heap[i] = id;
+    for ( ; i > 0 && DEATH(i) < DEATH((i - 1) / 2); i = (i - 1) / 2)
+	heap_swap(g, i, (i - 1) / 2);
+}
+
+static int heap_pop(mmgen_t *g)
+{
+    int id = g->heap[0], n = g->num_live - 1, i = 0, c;
+
+    heap_swap(g, 0, n);
+    while ((c = 2 * i + 1) < n) {
+	if (c + 1 < n && DEATH(c + 1) < DEATH(c))
+	    c++;
+	if (DEATH(i) <= DEATH(c))
+	    break;
+	heap_swap(g, i, c);
+	i = c;
+    }
+    return id;
+}
+
+/*
+ * new_id - an id for a new block: a dead one if there is one, else
+ *     the next unused one. Return -1 if out of memory.
+ */
+static int new_id(mmgen_t *g)
+{
+    int cap;
+
+    if (g->num_free_ids > 0)
+	return g->free_ids[--g->num_free_ids];
+    if (g->num_ids == g->cap_ids) {
+	cap = g->cap_ids ? 2 * g->cap_ids : 1024;
+	if ((g->blocks = realloc(g->blocks, cap * sizeof(gen_block_t))) == NULL ||
+	    (g->free_ids = realloc(g->free_ids, cap * sizeof(int))) == NULL ||
+	    (g->heap = realloc(g->heap, cap * sizeof(int))) == NULL ||
+	    (g->live = realloc(g->live, cap * sizeof(int))) == NULL)
+	    return -1;
+	g->cap_ids = cap;
+    }
+    return g->num_ids++;
+}
+
+/*
+ * gen_alloc - make a new block of size bytes live and describe it in *op
+ */
+static int gen_alloc(mmgen_t *g, int size, traceop_t *op)
+{
+    int id;
+
+    if ((id = new_id(g)) < 0)
+	return -1;
+    g->blocks[id].size = size;
+    g->blocks[id].death = g->now + 1 + (long)sample(g, &g->life);
+    heap_push(g, id);
+    g->blocks[id].lpos = g->num_live;
+    g->live[g->num_live++] = id;
+    g->live_bytes += size;
+    if (g->live_bytes > g->peak_live)
+	g->peak_live = g->live_bytes;
+    op->type = ALLOC;
+    op->index = id;
+    op->size = size;
+    return 0;
+}
+
+/*
+ * gen_free - free the block that dies next and describe it in *op
+ */
+static void gen_free(mmgen_t *g, traceop_t *op)
+{
+    int id = heap_pop(g), last;
+
+    last = g->live[--g->num_live];
+    g->live[g->blocks[id].lpos] = last;
+    g->blocks[last].lpos = g->blocks[id].lpos;
+    g->live_bytes -= g->blocks[id].size;
+    g->free_ids[g->num_free_ids++] = id;
+    op->type = FREE;
+    op->index = id;
+    op->size = 0;
+}
+
+/*
+ * gen_realloc - resize a random live block and describe it in *op
+ */
+static void gen_realloc(mmgen_t *g, traceop_t *op)
+{
+    int id = g->live[(int)(rnd(g) * g->num_live)];
+    int size = clamp_size(g, g->blocks[id].size * g->realloc_f);
+
+    g->live_bytes += size - g->blocks[id].size;
+    if (g->live_bytes > g->peak_live)
+	g->peak_live = g->live_bytes;
+    g->blocks[id].size = size;
+    op->type = REALLOC;
+    op->index = id;
+    op->size = size;
+}
+
+/*
+ * mmgen_next - store up to max of the next ops in ops[]
+ */
+int mmgen_next(mmgen_t *g, traceop_t *ops, int max)
+{
+    int n, size;
+
+    for (n = 0; n < max; n++) {
+	/* The workload is over: free what is left in order of death */
+	if (g->now >= g->ops) {
+	    if (g->num_live == 0)
+		break;
+	    gen_free(g, &ops[n]);
+	    continue;
+	}
+
+	if (g->num_live > 0 && DEATH(0) <= g->now)
+	    gen_free(g, &ops[n]);
+	else if (g->num_live > 0 && g->realloc_p > 0 && rnd(g) < g->realloc_p)
+	    gen_realloc(g, &ops[n]);
+	else {
+	    size = g->pending ? g->pending : clamp_size(g, sample(g, &g->size));
+	    g->pending = 0;
+	    if (g->live_max > 0 && g->num_live > 0 &&
+		g->live_bytes + size > g->live_max) {
+		g->pending = size;
+		gen_free(g, &ops[n]);
+	    }
+	    else if (gen_alloc(g, size, &ops[n]) < 0) {
+		fprintf(stderr, "mmgen: out of memory\n");
+		exit(1);
+	    }
+	}
+	g->now++;
+    }
+    return n;
+}
+
+/*
+ * parse_num - parse a number with an optional k, m, or g suffix.
+ *     Return -1 if s is not one.
+ */
+static double parse_num(char *s)
+{
+    char *end;
+    double x = strtod(s, &end);
+
+    switch (*end) {
+    case 'k': x *= 1e3; end++; break;
+    case 'm': x *= 1e6; end++; break;
+    case 'g': x *= 1e9; end++; break;
+    }
+    return (*end == '\0' && end != s && x >= 0) ? x : -1;
+}
+
+/*
+ * parse_dist - parse "kind:a[:b[:c]]" into *d. Return 0 on success.
+ */
+static int parse_dist(char *s, dist_t *d)
+{
+    static struct {
+	char *name;
+	int kind;
+	int nargs;
+    } kinds[] = {
+	{"uniform", DIST_UNIFORM, 2}, {"lognormal", DIST_LOGNORMAL, 2},
+	{"zipf", DIST_ZIPF, 2}, {"bimodal", DIST_BIMODAL, 3},
+	{"exp", DIST_EXP, 1}
+    };
+    double args[3] = {0, 0, 0};
+    char *tok;
+    int i, n = 0;
+
+    if ((tok = strtok(s, ":")) == NULL)
+	return -1;
+    for (i = 0; i < (int)(sizeof(kinds) / sizeof(kinds[0])); i++)
+	if (!strcmp(tok, kinds[i].name))
+	    break;
+    if (i == (int)(sizeof(kinds) / sizeof(kinds[0])))
+	return -1;
+    while ((tok = strtok(NULL, ":")) != NULL) {
+	if (n == 3 || (args[n++] = parse_num(tok)) < 0)
+	    return -1;
+    }
+    if (n != kinds[i].nargs)
+	return -1;
+    d->kind = kinds[i].kind;
+    d->a = args[0];
+    d->b = args[1];
+    d->c = args[2];
+    return 0;
+}
+
+/*
+ * parse_spec - parse the key=value pairs of spec into g. Return 0 on
+ *     success, or -1 after printing what is wrong.
+ */
+static int parse_spec(mmgen_t *g, char *spec)
+{
+    char *copy, *pair, *val, *save = NULL;
+    double x, y;
+    int ok = 1;
+
+    if ((copy = strdup(spec)) == NULL)
+	return -1;
+    for (pair = strtok_r(copy, ",", &save); pair != NULL;
+	 pair = strtok_r(NULL, ",", &save)) {
+	if ((val = strchr(pair, '=')) == NULL) {
+	    ok = 0;
+	    break;
+	}
+	*val++ = '\0';
+	if (!strcmp(pair, "ops"))
+	    ok = (x = parse_num(val)) > 0 && (g->ops = (long)x) > 0;
+	else if (!strcmp(pair, "size"))
+	    ok = parse_dist(val, &g->size) == 0 && g->size.kind != DIST_EXP;
+	else if (!strcmp(pair, "life"))
+	    ok = parse_dist(val, &g->life) == 0 &&
+		(g->life.kind == DIST_EXP || g->life.kind == DIST_UNIFORM);
+	else if (!strcmp(pair, "realloc"))
+	    ok = sscanf(val, "%lf:%lf", &x, &y) == 2 && x >= 0 && x <= 1 &&
+		y > 0 && ((g->realloc_p = x), (g->realloc_f = y), 1);
+	else if (!strcmp(pair, "live"))
+	    ok = (x = parse_num(val)) >= 0 && ((g->live_max = (size_t)x), 1);
+	else if (!strcmp(pair, "max"))
+	    ok = (x = parse_num(val)) >= 1 && x <= 1 << 30 &&
+		((g->max_size = (int)x), 1);
+	else if (!strcmp(pair, "seed"))
+	    ok = (x = parse_num(val)) >= 0 &&
+		((g->rng = (unsigned long long)x + 1), 1);
+	else
+	    ok = 0;
+	if (!ok)
+	    break;
+    }
+    if (!ok)
+	fprintf(stderr, "Bad workload spec \"%s\" at \"%s\"\n", spec, pair);
+    else if (g->size.kind == DIST_ZIPF && (g->size.a < 1 || g->size.a > 1 << 20))
+	fprintf(stderr, "The zipf rank must be in 1..%d\n", 1 << 20), ok = 0;
+    else if (g->size.kind == DIST_UNIFORM && g->size.b < g->size.a)
+	fprintf(stderr, "The uniform size range is empty\n"), ok = 0;
+    free(copy);
+    return ok ? 0 : -1;
+}
+
+/*
+ * mmgen_new - create a generator from spec, or return NULL
+ */
+mmgen_t *mmgen_new(char *spec)
+{
+    mmgen_t *g;
+    int k, n;
+
+    if ((g = calloc(1, sizeof(mmgen_t))) == NULL)
+	return NULL;
+    g->ops = 1000000;
+    g->size.kind = DIST_LOGNORMAL;
+    g->size.a = 64;
+    g->size.b = 1;
+    g->life.kind = DIST_EXP;
+    g->life.a = 10000;
+    g->realloc_f = 1;
+    g->max_size = 1 << 20;
+    g->rng = 2;
+    if (parse_spec(g, spec) < 0) {
+	free(g);
+	return NULL;
+    }
+
+    if (g->size.kind == DIST_ZIPF) {
+	n = (int)g->size.a;
+	if ((g->zipf_cdf = malloc(n * sizeof(double))) == NULL) {
+	    free(g);
+	    return NULL;
+	}
+	for (k = 0; k < n; k++)
+	    g->zipf_cdf[k] = (k ? g->zipf_cdf[k - 1] : 0) +
+		pow(k + 1, -g->size.b);
+    }
+    return g;
+}
+
+/*
+ * mmgen_free - free the generator
+ */
+void mmgen_free(mmgen_t *g)
+{
+    free(g->zipf_cdf);
+    free(g->blocks);
+    free(g->free_ids);
+    free(g->heap);
+    free(g->live);
+    free(g);
+}
+
+/*
+ * mmgen_num_ids - number of ids handed out so far
+ */
+int mmgen_num_ids(mmgen_t *g)
+{
+    return g->num_ids;
+}
+
+/*
+ * mmgen_peak_live - most payload bytes that were live at once so far
+ */
+size_t mmgen_peak_live(mmgen_t *g)
+{
+    return g->peak_live;
+}
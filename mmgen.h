@@ -0,0 +1,25 @@
+/*
+ * Synthetic workload generator
+ */
+#include <stddef.h>
+#include "trace.h"
+
+typedef struct mmgen mmgen_t;
+
+/* Create a generator from a spec such as
+   "ops=1m,size=lognormal:64:1,life=exp:10000,realloc=0.05:1.5,live=4m".
+   Return NULL, after printing why on stderr, if the spec is bad */
+mmgen_t *mmgen_new(char *spec);
+
+/* Free the generator */
+void mmgen_free(mmgen_t *g);
+
+/* Store up to max of the next ops in ops[]. Return how many were
+   stored, which is 0 once the workload is over */
+int mmgen_next(mmgen_t *g, traceop_t *ops, int max);
+
+/* Number of ids handed out so far; every op index is below it */
+int mmgen_num_ids(mmgen_t *g);
+
+/* Most payload bytes that were live at once so far */
+size_t mmgen_peak_live(mmgen_t *g);
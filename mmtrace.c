@@ -0,0 +1,667 @@
+/*
+ * mmtrace.c - Capture the malloc, calloc, realloc, and free calls of a
+ *     running program as an mdriver trace.
+ *
+ * Build libmmtrace.so with "make mmtrace" and run the program with
+ *
+ *     LD_PRELOAD=./libmmtrace.so MMTRACE_OUT=prog.rep prog args...
+ *
+ * Each call is passed on to the libc allocator and logged as a record
+ * with a global sequence number into a buffer of the calling thread.
+ * Full buffers are handed to a writer thread that appends them to
+ * <out>.raw, so the program only pays for the record and an atomic
+ * increment. Each buffer is a run of records in sequence order, since
+ * one thread filled it. At exit the runs are merged a few records at a
+ * time, the pointers are turned into block ids, and <out> is written
+ * in the text trace format (default out: mmtrace.<pid>.rep). Only the
+ * blocks that are live at some point of the merge are kept in memory.
+ *
+ * Blocks that came from elsewhere (posix_memalign, or before the shim
+ * was ready) are unknown to the trace, so their frees are dropped and
+ * a realloc of one becomes a fresh alloc. malloc(0) is logged as a
+ * one-byte request, since the driver needs positive sizes.
+ *
+ * Forked children are not traced. Programs that the traced one execs
+ * inherit LD_PRELOAD, but not MMTRACE_OUT, which the shim takes out of
+ * the environment, so each of them writes a trace of its own under the
+ * default name. The raw file is created exclusively: a process never
+ * writes over the capture of another, and is not traced if it would.
+ * A process that replaces itself with exec never gets to exit, so its
+ * <out>.raw is left behind unconverted. So is the one of a capture that
+ * could not be converted, and no partial <out> is left next to it.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* The libc allocator that the wrappers pass calls on to */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+#define BUF_RECS 4096   /* records per thread buffer */
+#define RUN_RECS 64     /* records of a run read at a time when merging */
+
+/* One logged call */
+typedef struct {
+    unsigned long seq;  /* global order of the call */
+    int type;           /* 'a', 'r', 'f', or 'm' */
+    void *ptr;          /* block returned (a), freed (f), or resized (r, m) */
+    void *newptr;       /* block returned by a realloc */
+    size_t size;        /* requested size (a, r) */
+} rec_t;
+
+/* A buffer of records, owned by one thread until it is full */
+typedef struct buf {
+    int n;                  /* records in use */
+    int keep;               /* still reachable by its thread: don't free */
+    struct buf *next;       /* next buffer in the writer queue... */
+    struct buf *prev_live;  /* ... or neighbours among the live buffers */
+    struct buf *next_live;
+    rec_t recs[BUF_RECS];
+} buf_t;
+
+static int ready;                /* set while calls are being logged */
+static unsigned long seq;        /* next sequence number */
+static char out_path[PATH_MAX];  /* the trace we write at exit... */
+static char raw_path[PATH_MAX+4]; /* ... and the raw records before that */
+static int raw_fd = -1;          /* unbuffered, so a forked child that
+				    exits has nothing of ours to flush */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static buf_t *queue, *queue_tail; /* full buffers for the writer */
+static buf_t *live_bufs;         /* buffers that threads are filling */
+static int stopping;             /* tells the writer to drain and quit */
+static pthread_t writer;
+static pthread_key_t buf_key;    /* flushes a thread's buffer at its exit */
+
+/* Initial-exec TLS, since the dynamic model may call malloc itself */
+static __thread buf_t *my_buf __attribute__((tls_model("initial-exec")));
+static __thread int busy __attribute__((tls_model("initial-exec")));
+
+static int finalize(void);
+
+/*
+ * atfork_child - a forked child has no writer thread, so it is not traced
+ */
+static void atfork_child(void)
+{
+    ready = 0;
+}
+
+/*
+ * enqueue - hand a buffer to the writer. Called with the lock held.
+ */
+static void enqueue(buf_t *b)
+{
+    if (b->prev_live != NULL)
+	b->prev_live->next_live = b->next_live;
+    else if (live_bufs == b)
+	live_bufs = b->next_live;
+    if (b->next_live != NULL)
+	b->next_live->prev_live = b->prev_live;
+    b->prev_live = b->next_live = NULL;
+
+    b->next = NULL;
+    if (queue_tail != NULL)
+	queue_tail->next = b;
+    else
+	queue = b;
+    queue_tail = b;
+    pthread_cond_signal(&cond);
+}
+
+/*
+ * new_buf - a fresh buffer for the calling thread, or NULL
+ */
+static buf_t *new_buf(void)
+{
+    buf_t *b = __libc_malloc(sizeof(buf_t));
+
+    if (b == NULL)
+	return NULL;
+    b->n = 0;
+    b->keep = 0;
+    b->next = NULL;
+    pthread_mutex_lock(&lock);
+    b->prev_live = NULL;
+    b->next_live = live_bufs;
+    if (live_bufs != NULL)
+	live_bufs->prev_live = b;
+    live_bufs = b;
+    pthread_mutex_unlock(&lock);
+    return b;
+}
+
+/*
+ * thread_exit - key destructor that flushes an exiting thread's buffer
+ */
+static void thread_exit(void *arg)
+{
+    buf_t *b = arg;
+
+    pthread_mutex_lock(&lock);
+    if (ready && my_buf == b) {
+	my_buf = NULL;
+	enqueue(b);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * logrec - log one call. seq is taken by the caller, before a free
+ *     and after an alloc, so that a block is never reused in the
+ *     trace before it was freed.
+ */
+static void logrec(unsigned long s, int type, void *ptr, void *newptr,
+		   size_t size)
+{
+    buf_t *b = my_buf;
+    rec_t *r;
+
+    if (b == NULL) {
+	if ((b = my_buf = new_buf()) == NULL)
+	    return;
+	pthread_setspecific(buf_key, b);
+    }
+    r = &b->recs[b->n++];
+    r->seq = s;
+    r->type = type;
+    r->ptr = ptr;
+    r->newptr = newptr;
+    r->size = size;
+    if (b->n == BUF_RECS) {
+	pthread_mutex_lock(&lock);
+	my_buf = NULL;
+	enqueue(b);
+	pthread_mutex_unlock(&lock);
+	pthread_setspecific(buf_key, NULL);
+    }
+}
+
+#define NEXT_SEQ() __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED)
+
+/* Stands in for a block that a realloc moved, between its two records.
+   Real blocks are aligned, so an odd value never names one */
+#define MOVE_TOKEN(s) ((void *)(2 * (s) + 1))
+
+/*
+ * The wrappers. busy keeps the shim's own calls (and those of the
+ * writer thread) out of the trace.
+ */
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+
+    if (ready && !busy && p != NULL) {
+	busy = 1;
+	logrec(NEXT_SEQ(), 'a', p, NULL, size);
+	busy = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p = __libc_calloc(n, size);
+
+    if (ready && !busy && p != NULL) {
+	busy = 1;
+	logrec(NEXT_SEQ(), 'a', p, NULL, n * size);
+	busy = 0;
+    }
+    return p;
+}
+
+/*
+ * A realloc that moves a block both frees ptr and allocates p inside
+ * libc, so it takes a seq before the call, like free, and one after,
+ * like malloc. The first ('m') hands the id of ptr to a token and the
+ * second ('r') resizes the token's id into p, so another thread that
+ * gets ptr or frees p in between is ordered right.
+ */
+void *realloc(void *ptr, size_t size)
+{
+    unsigned long s = 0;
+    int log = ready && !busy;
+    void *p;
+
+    if (log && ptr != NULL)
+	s = NEXT_SEQ();
+    p = __libc_realloc(ptr, size);
+
+    if (log && ready && (p != NULL || size == 0)) {
+	busy = 1;
+	if (ptr == NULL)
+	    logrec(NEXT_SEQ(), 'a', p, NULL, size);
+	else if (p == NULL)
+	    logrec(s, 'f', ptr, NULL, 0);
+	else if (p == ptr)
+	    logrec(s, 'r', ptr, p, size);
+	else {
+	    logrec(s, 'm', ptr, MOVE_TOKEN(s), 0);
+	    logrec(NEXT_SEQ(), 'r', MOVE_TOKEN(s), p, size);
+	}
+	busy = 0;
+    }
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ready && !busy && ptr != NULL) {
+	busy = 1;
+	logrec(NEXT_SEQ(), 'f', ptr, NULL, 0);
+	busy = 0;
+    }
+    __libc_free(ptr);
+}
+
+/*
+ * write_all - write n bytes to the raw file, retrying short writes
+ */
+static void write_all(const void *p, size_t n)
+{
+    ssize_t k;
+
+    while (n > 0) {
+	if ((k = write(raw_fd, p, n)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return;
+	}
+	p = (const char *)p + k;
+	n -= k;
+    }
+}
+
+/*
+ * writer_main - append full buffers to the raw file until stopped, each
+ *     as a record count followed by the records
+ */
+static void *writer_main(void *arg)
+{
+    buf_t *b;
+    int keep;
+
+    busy = 1;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+	while (queue == NULL && !stopping)
+	    pthread_cond_wait(&cond, &lock);
+	if ((b = queue) == NULL)
+	    break;
+	if ((queue = b->next) == NULL)
+	    queue_tail = NULL;
+	keep = b->keep;
+	pthread_mutex_unlock(&lock);
+	write_all(&b->n, sizeof(int));
+	write_all(b->recs, sizeof(rec_t) * b->n);
+	if (!keep)
+	    __libc_free(b);
+	pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/*
+ * mmtrace_init - open the raw file and start the writer
+ */
+__attribute__((constructor))
+static void mmtrace_init(void)
+{
+    char *out = getenv("MMTRACE_OUT");
+
+    busy = 1;
+    if (out != NULL && *out != '\0')
+	snprintf(out_path, sizeof(out_path), "%s", out);
+    else
+	snprintf(out_path, sizeof(out_path), "mmtrace.%d.rep", (int)getpid());
+    snprintf(raw_path, sizeof(raw_path), "%s.raw", out_path);
+
+    /* Programs that this one execs fall back to a name of their own */
+    unsetenv("MMTRACE_OUT");
+
+    if ((raw_fd = open(raw_path, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0) {
+	fprintf(stderr, "mmtrace: could not create %s (another capture is "
+		"using it, or one was cut short)\n", raw_path);
+	busy = 0;
+	return;
+    }
+    if (pthread_key_create(&buf_key, thread_exit) != 0 ||
+	pthread_atfork(NULL, NULL, atfork_child) != 0 ||
+	pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+	fprintf(stderr, "mmtrace: could not start the writer thread\n");
+	close(raw_fd);
+	unlink(raw_path);
+	busy = 0;
+	return;
+    }
+    ready = 1;
+    busy = 0;
+}
+
+/*
+ * mmtrace_fini - stop logging, drain every buffer, and write the trace
+ */
+__attribute__((destructor))
+static void mmtrace_fini(void)
+{
+    if (!ready)
+	return;
+    busy = 1;
+    ready = 0;
+
+    /* Other threads may still hold their buffers, so the writer must 
+       not free them */
+    pthread_mutex_lock(&lock);
+    my_buf = NULL;
+    while (live_bufs != NULL) {
+	live_bufs->keep = 1;
+	enqueue(live_bufs);
+    }
+    stopping = 1;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+    pthread_join(writer, NULL);
+    close(raw_fd);
+
+    if (finalize() == 0)
+	unlink(raw_path);
+    else
+	fprintf(stderr, "mmtrace: kept %s\n", raw_path);
+}
+
+/*
+ * Map from live block addresses to trace ids: open addressing with
+ * linear probing, and backward shift deletion so no tombstones pile up
+ */
+typedef struct {
+    void *ptr;   /* NULL marks an empty slot */
+    int id;
+    int size;    /* its size in the trace */
+} slot_t;
+
+static slot_t *slots;
+static size_t num_slots, num_used;
+
+#define HASH(p) ((((size_t)(p) >> 4) * 0x9e3779b97f4a7c15ULL) & (num_slots - 1))
+
+static void map_put(void *ptr, int id, int size);
+
+static void map_grow(void)
+{
+    slot_t *old = slots;
+    size_t i, n = num_slots;
+
+    num_slots = n ? 2 * n : 1024;
+    if ((slots = calloc(num_slots, sizeof(slot_t))) == NULL) {
+	fprintf(stderr, "mmtrace: out of memory\n");
+	exit(1);
+    }
+    num_used = 0;
+    for (i = 0; i < n; i++)
+	if (old[i].ptr != NULL)
+	    map_put(old[i].ptr, old[i].id, old[i].size);
+    free(old);
+}
+
+static void map_put(void *ptr, int id, int size)
+{
+    size_t i;
+
+    if (2 * (num_used + 1) > num_slots)
+	map_grow();
+    for (i = HASH(ptr); slots[i].ptr != NULL && slots[i].ptr != ptr;
+	 i = (i + 1) & (num_slots - 1))
+	;
+    if (slots[i].ptr == NULL)
+	num_used++;
+    slots[i].ptr = ptr;
+    slots[i].id = id;
+    slots[i].size = size;
+}
+
+/* Remove ptr and return its id and size, or -1 if it is not live */
+static int map_take(void *ptr, int *size)
+{
+    size_t i, j, h;
+    int id;
+
+    if (num_slots == 0)
+	return -1;
+    for (i = HASH(ptr); slots[i].ptr != ptr; i = (i + 1) & (num_slots - 1))
+	if (slots[i].ptr == NULL)
+	    return -1;
+    id = slots[i].id;
+    *size = slots[i].size;
+    for (j = (i + 1) & (num_slots - 1); slots[j].ptr != NULL;
+	 j = (j + 1) & (num_slots - 1)) {
+	h = HASH(slots[j].ptr);
+	/* move slot j back to i unless its home lies cyclically in (i, j] */
+	if ((j > i && (h <= i || h > j)) || (j < i && h <= i && h > j)) {
+	    slots[i] = slots[j];
+	    i = j;
+	}
+    }
+    slots[i].ptr = NULL;
+    num_used--;
+    return id;
+}
+
+/*
+ * One buffer's run of records in the raw file, read RUN_RECS at a time.
+ * The merge keeps a min-heap of the runs on the seq of their next record.
+ */
+typedef struct {
+    long off;           /* file offset of the first record not yet read */
+    int left;           /* records not yet read */
+    int pos, n;         /* next record in recs, and records in recs */
+    rec_t recs[RUN_RECS];
+} run_t;
+
+static run_t *runs;
+static int *heap, heap_n;
+
+#define RUN_SEQ(k) (runs[heap[k]].recs[runs[heap[k]].pos].seq)
+
+/*
+ * run_fill - read the next records of run r. Return how many, 0 at its
+ *     end, or -1 if the raw file is cut short.
+ */
+static int run_fill(FILE *f, run_t *r)
+{
+    r->n = r->left < RUN_RECS ? r->left : RUN_RECS;
+    r->pos = 0;
+    if (r->n == 0)
+	return 0;
+    if (fseek(f, r->off, SEEK_SET) != 0 ||
+	(int)fread(r->recs, sizeof(rec_t), r->n, f) != r->n)
+	return -1;
+    r->off += r->n * sizeof(rec_t);
+    r->left -= r->n;
+    return r->n;
+}
+
+/*
+ * sift_down - restore the heap below slot k
+ */
+static void sift_down(int k)
+{
+    int c, t;
+
+    while ((c = 2 * k + 1) < heap_n) {
+	if (c + 1 < heap_n && RUN_SEQ(c + 1) < RUN_SEQ(c))
+	    c++;
+	if (RUN_SEQ(k) <= RUN_SEQ(c))
+	    break;
+	t = heap[k];
+	heap[k] = heap[c];
+	heap[c] = t;
+	k = c;
+    }
+}
+
+/*
+ * req_size - a logged size as a trace size, which must be a positive int
+ */
+static int req_size(size_t size)
+{
+    if (size == 0)
+	return 1;
+    return size > INT_MAX ? INT_MAX : (int)size;
+}
+
+/*
+ * write_header - write the header of the trace. It is written once
+ *     with zeros and again at the end, padded to the same width.
+ */
+static void write_header(FILE *f, size_t peak, int num_ids, long num_ops)
+{
+    /* sugg_heapsize, num_ids, num_ops, weight */
+    fprintf(f, "%-20lu\n%-11d\n%-20ld\n%d\n", (unsigned long)peak, num_ids,
+	    num_ops, 1);
+}
+
+/*
+ * open_runs - find the runs of the raw file, read the first records of
+ *     each, and put them on the heap. Return -1 if the file is cut short.
+ */
+static int open_runs(FILE *f)
+{
+    run_t *r;
+    int n, i, k, num_runs = 0, cap_runs = 0;
+
+    while (fread(&n, sizeof(int), 1, f) == 1) {
+	if (num_runs == cap_runs) {
+	    cap_runs = cap_runs ? 2 * cap_runs : 64;
+	    if ((runs = realloc(runs, cap_runs * sizeof(run_t))) == NULL) {
+		fprintf(stderr, "mmtrace: out of memory\n");
+		exit(1);
+	    }
+	}
+	r = &runs[num_runs++];
+	r->off = ftell(f);
+	r->left = n;
+	if (n < 0 || fseek(f, n * sizeof(rec_t), SEEK_CUR) != 0)
+	    return -1;
+    }
+    if ((heap = malloc(num_runs * sizeof(int) + 1)) == NULL) {
+	fprintf(stderr, "mmtrace: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < num_runs; i++) {
+	if ((n = run_fill(f, &runs[i])) < 0)
+	    return -1;
+	if (n > 0)
+	    heap[heap_n++] = i;
+    }
+    for (k = heap_n / 2 - 1; k >= 0; k--)
+	sift_down(k);
+    return 0;
+}
+
+/*
+ * finalize - merge the runs of the raw file, assign ids, and write the
+ *     trace. Returns 0, or -1 with no trace written.
+ */
+static int finalize(void)
+{
+    FILE *f, *out;
+    run_t *r;
+    rec_t rec;
+    long num_ops = 0;
+    int n, num_ids = 0, id, size, type, cut = 0;
+    size_t live = 0, peak = 0;
+
+    if ((f = fopen(raw_path, "r")) == NULL) {
+	fprintf(stderr, "mmtrace: could not open %s\n", raw_path);
+	return -1;
+    }
+    if (open_runs(f) < 0) {
+	fprintf(stderr, "mmtrace: could not read %s\n", raw_path);
+	fclose(f);
+	return -1;
+    }
+    if ((out = fopen(out_path, "w")) == NULL) {
+	fprintf(stderr, "mmtrace: could not create %s\n", out_path);
+	fclose(f);
+	return -1;
+    }
+    write_header(out, 0, 0, 0);
+
+    while (heap_n > 0) {
+	/* Take the next record in seq order, and move its run along */
+	r = &runs[heap[0]];
+	rec = r->recs[r->pos++];
+	if (r->pos == r->n && (n = run_fill(f, r)) <= 0) {
+	    if (n < 0) {
+		cut = 1;
+		break;
+	    }
+	    heap[0] = heap[--heap_n];
+	}
+	sift_down(0);
+
+	if (rec.type == 'm') {
+	    /* Not an op of its own: the 'r' with the token follows */
+	    if ((id = map_take(rec.ptr, &size)) >= 0)
+		map_put(rec.newptr, id, size);
+	    continue;
+	}
+	if (rec.type == 'f') {
+	    if ((id = map_take(rec.ptr, &size)) < 0)
+		continue;
+	    fprintf(out, "f %d\n", id);
+	    live -= size;
+	}
+	else {
+	    id = (rec.type == 'r') ? map_take(rec.ptr, &size) : -1;
+	    type = (id < 0) ? 'a' : 'r';
+	    if (id < 0) {
+		id = num_ids++;
+		size = 0;
+	    }
+	    n = req_size(rec.size);
+	    fprintf(out, "%c %d %d\n", type, id, n);
+	    live += n - size;
+	    /* If libc reused a block before its free was logged, the old
+	       id simply stays allocated in the trace */
+	    map_take(rec.type == 'r' ? rec.newptr : rec.ptr, &size);
+	    map_put(rec.type == 'r' ? rec.newptr : rec.ptr, id, n);
+	}
+	if (live > peak)
+	    peak = live;
+	num_ops++;
+    }
+    fclose(f);
+    free(runs);
+    free(heap);
+    free(slots);
+    if (cut) {
+	fprintf(stderr, "mmtrace: could not read %s\n", raw_path);
+	fclose(out);
+	unlink(out_path);
+	return -1;
+    }
+
+    rewind(out);
+    write_header(out, peak, num_ids, num_ops);
+    if (fclose(out) != 0) {
+	fprintf(stderr, "mmtrace: could not write %s\n", out_path);
+	unlink(out_path);
+	return -1;
+    }
+    fprintf(stderr, "mmtrace: wrote %ld ops on %d ids to %s\n",
+	    num_ops, num_ids, out_path);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * perfctr.c - Count hardware events with the Linux perf_event_open
+ *     system call.
+ *
+ * Each counter is opened on its own, for the calling thread and user
+ * mode only, so that a counter the CPU or the kernel does not support
+ * (or that perf_event_paranoid forbids) only drops that one column.
+ * On systems without perf events all counters are simply unavailable.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* file descriptor of each counter, or -1 if it is unavailable */
+static int fds[PERFCTR_NUM] = {-1, -1, -1, -1, -1};
+
+static const char *names[PERFCTR_NUM] = {
+    "cyc/op", "ins/op", "L1m/op", "LLm/op", "brm/op"
+};
+
+#ifdef __linux__
+/*
+ * open_counter - open one user-mode counter for this thread, disabled
+ */
+static int open_counter(unsigned type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+#endif
+
+/*
+ * perfctr_init - open the counters and return how many are available
+ */
+int perfctr_init(void)
+{
+    int i, n = 0;
+
+#ifdef __linux__
+    fds[PERFCTR_CYCLES] =
+	open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[PERFCTR_INSTRS] =
+	open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[PERFCTR_L1_MISSES] =
+	open_counter(PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D));
+    fds[PERFCTR_LL_MISSES] =
+	open_counter(PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL));
+    fds[PERFCTR_BR_MISSES] =
+	open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#else
+    errno = ENOSYS;
+#endif
+
+    for (i = 0; i < PERFCTR_NUM; i++)
+	if (fds[i] >= 0)
+	    n++;
+    if (n == 0)
+	fprintf(stderr, "Hardware counters unavailable (perf_event_open: %s)\n",
+		strerror(errno));
+    return n;
+}
+
+/*
+ * perfctr_deinit - close the counters
+ */
+void perfctr_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+	if (fds[i] >= 0)
+	    close(fds[i]);
+	fds[i] = -1;
+    }
+}
+
+/*
+ * perfctr_start - reset and enable the counters
+ */
+void perfctr_start(void)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+#endif
+}
+
+/*
+ * perfctr_stop - disable the counters and read them into *ctr. A
+ *     counter the kernel had to multiplex is scaled up by the fraction
+ *     of the time it was actually running.
+ */
+void perfctr_stop(perfctr_t *ctr)
+{
+    int i;
+#ifdef __linux__
+    unsigned long long val[3]; /* value, time enabled, time running */
+
+    for (i = 0; i < PERFCTR_NUM; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+	ctr->valid[i] = 0;
+	ctr->count[i] = 0;
+#ifdef __linux__
+	if (fds[i] < 0 || read(fds[i], val, sizeof(val)) != sizeof(val) ||
+	    val[2] == 0)
+	    continue;
+	ctr->valid[i] = 1;
+	ctr->count[i] = (double)val[0];
+	if (val[2] < val[1])
+	    ctr->count[i] *= (double)val[1] / (double)val[2];
+#endif
+    }
+}
+
+/*
+ * perfctr_name - short column name of counter i
+ */
+const char *perfctr_name(int i)
+{
+    return names[i];
+}
@@ -0,0 +1,33 @@
+/*
+ * Hardware performance counters
+ */
+
+/* The counters we try to collect */
+#define PERFCTR_CYCLES    0  /* CPU cycles */
+#define PERFCTR_INSTRS    1  /* retired instructions */
+#define PERFCTR_L1_MISSES 2  /* L1 data cache read misses */
+#define PERFCTR_LL_MISSES 3  /* last level cache read misses */
+#define PERFCTR_BR_MISSES 4  /* mispredicted branches */
+#define PERFCTR_NUM       5
+
+/* Counter values for one measured interval */
+typedef struct {
+    int valid[PERFCTR_NUM];     /* was this counter available? */
+    double count[PERFCTR_NUM];  /* its value, scaled if it was multiplexed */
+} perfctr_t;
+
+/* Open the counters. Return how many of them are available; if none
+   are, print why once on stderr */
+int perfctr_init(void);
+
+/* Close the counters */
+void perfctr_deinit(void);
+
+/* Reset and start the counters */
+void perfctr_start(void);
+
+/* Stop the counters and store their values in *ctr */
+void perfctr_stop(perfctr_t *ctr);
+
+/* Short column name of counter i */
+const char *perfctr_name(int i);
@@ -0,0 +1,38 @@
+/*
+ * trace.h - The ops the driver replays against a malloc package, as 
+ *     read from a trace file or produced by the workload generator,
+ *     and the layout of binary trace files
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Binary trace files start with this magic number (reads as "MMBT") */
+#define BTRACE_MAGIC   0x54424d4d
+#define BTRACE_VERSION 1
+
+/* 
+ * Header of a binary trace file. It is followed directly by num_ops 
+ * traceop_t records in host byte order, so the op array can be mapped 
+ * into memory as is.
+ */
+typedef struct {
+    unsigned magic;      /* BTRACE_MAGIC */
+    unsigned version;    /* BTRACE_VERSION */
+    int sugg_heapsize;   /* same four fields as the text header */
+    int num_ids;
+    int num_ops;
+    int weight;
+    int pad[2];          /* keep the op records 16-byte aligned */
+} btrace_hdr_t;
+
+/* The on-disk record layout must match traceop_t exactly */
+typedef char btrace_check_t[(sizeof(traceop_t) == 3 * sizeof(int)) ? 1 : -1];
+
+#endif /* __TRACE_H_ */
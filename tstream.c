@@ -0,0 +1,396 @@
+/*
+ * tstream.c - Read a trace a chunk at a time, for traces that are too
+ *     big to be loaded in memory as a whole.
+ *
+ * A reader thread parses the trace (text, the binary format of mdriver
+ * -w, or the compressed one of mdriver -z) into one of two chunk
+ * buffers while the replay works through the other, so reading and
+ * parsing overlap with the replay.
+ * Only the two buffers are ever in memory, however long the trace.
+ * The text header's op count may exceed the range of an int here; ids
+ * and sizes must still fit in one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "tstream.h"
+#include "ztrace.h"
+
+#define STREAM_CHUNK 65536   /* ops per chunk buffer */
+#define STREAM_IOBUF (1<<20) /* stdio buffer of the trace file */
+#define STREAM_ZBUF  (1<<18) /* bytes of a compressed trace decoded at a time */
+
+/* Trace file formats */
+#define FMT_TEXT       0
+#define FMT_BINARY     1
+#define FMT_COMPRESSED 2
+
+struct tstream {
+    char *path;
+    FILE *fp;
+    char *iobuf;
+    int format;              /* FMT_TEXT, FMT_BINARY, or FMT_COMPRESSED */
+    int sugg_heapsize;       /* the header fields */
+    int num_ids;
+    int weight;
+    long long num_ops;       /* ops the header promises... */
+    long long ops_read;      /* ... and those read so far */
+
+    /* Compressed traces only */
+    ztrace_ctx_t z;          /* decoder state */
+    unsigned char *zbuf;     /* bytes read but not yet decoded... */
+    const unsigned char *zpos; /* ... start here... */
+    const unsigned char *zend; /* ... and end here */
+    char err[256];           /* why the trace is malformed */
+
+    /* The two chunk buffers, handed back and forth under lock */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    traceop_t *buf[2];
+    int len[2];              /* ops in each buffer, 0 at the end, -1 on error */
+    int full[2];             /* filled by the reader, not yet given back */
+    int cur;                 /* buffer the replay holds, or -1 */
+    int done;                /* the end (or an error) was handed out */
+    int stop;                /* tells the reader to quit */
+    int started;             /* is there a reader thread? */
+    pthread_t reader;
+};
+
+/*
+ * read_num - parse the next unsigned number of a text trace into *x.
+ *     Return 0, or -1 if there is no number there or it is too big.
+ */
+static int read_num(FILE *fp, int *x)
+{
+    int c;
+    unsigned long v = 0;
+
+    while ((c = getc_unlocked(fp)) == ' ' || c == '\t')
+	;
+    if (c < '0' || c > '9')
+	return -1;
+    do {
+	v = 10 * v + (c - '0');
+	if (v > INT_MAX)
+	    return -1;
+    } while ((c = getc_unlocked(fp)) >= '0' && c <= '9');
+    ungetc(c, fp);
+    *x = (int)v;
+    return 0;
+}
+
+/*
+ * fill_text - parse up to STREAM_CHUNK ops of a text trace into ops[].
+ *     Return how many were parsed, or -1 if the trace is malformed.
+ */
+static int fill_text(tstream_t *s, traceop_t *ops)
+{
+    int c, n = 0;
+    traceop_t *op;
+
+    while (n < STREAM_CHUNK) {
+	while ((c = getc_unlocked(s->fp)) == ' ' || c == '\t' ||
+	       c == '\n' || c == '\r')
+	    ;
+	if (c == EOF)
+	    break;
+	op = &ops[n];
+	op->size = 0;
+	switch (c) {
+	case 'a':
+	    op->type = ALLOC;
+	    break;
+	case 'r':
+	    op->type = REALLOC;
+	    break;
+	case 'f':
+	    op->type = FREE;
+	    break;
+	default:
+	    snprintf(s->err, sizeof(s->err), "Bogus type character (%c) "
+		     "at op %lld", c, s->ops_read + n);
+	    return -1;
+	}
+	if (read_num(s->fp, &op->index) < 0 ||
+	    (op->type != FREE && read_num(s->fp, &op->size) < 0)) {
+	    snprintf(s->err, sizeof(s->err), "Bad number at op %lld",
+		     s->ops_read + n);
+	    return -1;
+	}
+	n++;
+    }
+    return n;
+}
+
+/*
+ * fill_binary - read up to STREAM_CHUNK op records of a binary trace
+ *     into ops[]. Return how many were read, or -1 if one is bad.
+ */
+static int fill_binary(tstream_t *s, traceop_t *ops)
+{
+    int i, n = fread(ops, sizeof(traceop_t), STREAM_CHUNK, s->fp);
+
+    for (i = 0; i < n; i++) {
+	if ((unsigned)ops[i].type > REALLOC || ops[i].index < 0 ||
+	    ops[i].size < 0) {
+	    snprintf(s->err, sizeof(s->err), "Bad op record %lld",
+		     s->ops_read + i);
+	    return -1;
+	}
+    }
+    return n;
+}
+
+/*
+ * fill_compressed - decode up to STREAM_CHUNK ops of a compressed 
+ *     trace into ops[], reading more bytes whenever the decoder runs 
+ *     short. Return how many were decoded, or -1 if one is bad.
+ */
+static int fill_compressed(tstream_t *s, traceop_t *ops)
+{
+    int n = 0, k;
+    size_t left;
+
+    for (;;) {
+	k = ztrace_decode(&s->z, &s->zpos, s->zend, ops + n, STREAM_CHUNK - n);
+	if (k < 0) {
+	    snprintf(s->err, sizeof(s->err), "Bad encoded op %lld",
+		     s->ops_read + n);
+	    return -1;
+	}
+	if ((n += k) == STREAM_CHUNK)
+	    break;
+
+	/* Keep the cut-off op, if any, and read more after it */
+	left = s->zend - s->zpos;
+	memmove(s->zbuf, s->zpos, left);
+	s->zpos = s->zbuf;
+	s->zend = s->zbuf + left + 
+	    fread(s->zbuf + left, 1, STREAM_ZBUF - left, s->fp);
+	if (s->zend == s->zbuf + left) {
+	    if (left > 0) {
+		snprintf(s->err, sizeof(s->err), "Truncated op %lld",
+			 s->ops_read + n);
+		return -1;
+	    }
+	    break;
+	}
+    }
+    return n;
+}
+
+/*
+ * fill - read the next chunk into ops[] and check, at the end, that
+ *     the trace had as many ops as its header said
+ */
+static int fill(tstream_t *s, traceop_t *ops)
+{
+    int n;
+
+    if (s->format == FMT_COMPRESSED)
+	n = fill_compressed(s, ops);
+    else if (s->format == FMT_BINARY)
+	n = fill_binary(s, ops);
+    else
+	n = fill_text(s, ops);
+
+    if (n < 0)
+	return -1;
+    s->ops_read += n;
+    if (n == 0 && s->ops_read != s->num_ops) {
+	snprintf(s->err, sizeof(s->err), "Trace has %lld ops, but its "
+		 "header says %lld", s->ops_read, s->num_ops);
+	return -1;
+    }
+    return n;
+}
+
+/*
+ * reader_main - fill the two buffers in turn until the end of the
+ *     trace, an error, or tstream_close
+ */
+static void *reader_main(void *arg)
+{
+    tstream_t *s = arg;
+    int w = 0, n;
+
+    for (;;) {
+	pthread_mutex_lock(&s->lock);
+	while (s->full[w] && !s->stop)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	if (s->stop) {
+	    pthread_mutex_unlock(&s->lock);
+	    break;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	n = fill(s, s->buf[w]);
+
+	pthread_mutex_lock(&s->lock);
+	s->len[w] = n;
+	s->full[w] = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	if (n <= 0)
+	    break;
+	w ^= 1;
+    }
+    return NULL;
+}
+
+/*
+ * read_header - read the header of the trace and note its format.
+ *     Return 0, or -1 if it is bad.
+ */
+static int read_header(tstream_t *s)
+{
+    btrace_hdr_t hdr;
+    ztrace_hdr_t zhdr;
+    unsigned magic = 0;
+
+    fread(&magic, sizeof(magic), 1, s->fp);
+    rewind(s->fp);
+    if (magic == BTRACE_MAGIC) {
+	if (fread(&hdr, sizeof(hdr), 1, s->fp) != 1 ||
+	    hdr.version != BTRACE_VERSION || hdr.num_ops < 0)
+	    return -1;
+	s->format = FMT_BINARY;
+	s->sugg_heapsize = hdr.sugg_heapsize;
+	s->num_ids = hdr.num_ids;
+	s->num_ops = hdr.num_ops;
+	s->weight = hdr.weight;
+	return 0;
+    }
+    if (magic == ZTRACE_MAGIC) {
+	if (fread(&zhdr, sizeof(zhdr), 1, s->fp) != 1 ||
+	    zhdr.version != ZTRACE_VERSION || zhdr.num_ops < 0)
+	    return -1;
+	if ((s->zbuf = malloc(STREAM_ZBUF)) == NULL)
+	    return -1;
+	s->format = FMT_COMPRESSED;
+	s->sugg_heapsize = zhdr.sugg_heapsize;
+	s->num_ids = zhdr.num_ids;
+	s->num_ops = zhdr.num_ops;
+	s->weight = zhdr.weight;
+	ztrace_init(&s->z);
+	s->zpos = s->zend = s->zbuf;
+	return 0;
+    }
+    if (fscanf(s->fp, "%d %d %lld %d", &s->sugg_heapsize, &s->num_ids,
+	       &s->num_ops, &s->weight) != 4 || s->num_ops < 0)
+	return -1;
+    s->format = FMT_TEXT;
+    return 0;
+}
+
+/*
+ * tstream_open - open the trace at path and start the reader thread
+ */
+tstream_t *tstream_open(char *path)
+{
+    tstream_t *s;
+
+    if ((s = calloc(1, sizeof(tstream_t))) == NULL) {
+	fprintf(stderr, "Out of memory in tstream_open\n");
+	return NULL;
+    }
+    s->cur = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if ((s->path = strdup(path)) == NULL ||
+	(s->iobuf = malloc(STREAM_IOBUF)) == NULL ||
+	(s->buf[0] = malloc(STREAM_CHUNK * sizeof(traceop_t))) == NULL ||
+	(s->buf[1] = malloc(STREAM_CHUNK * sizeof(traceop_t))) == NULL) {
+	fprintf(stderr, "Out of memory in tstream_open\n");
+	tstream_close(s);
+	return NULL;
+    }
+    if ((s->fp = fopen(path, "r")) == NULL) {
+	fprintf(stderr, "Could not open %s\n", path);
+	tstream_close(s);
+	return NULL;
+    }
+    setvbuf(s->fp, s->iobuf, _IOFBF, STREAM_IOBUF);
+    if (read_header(s) < 0) {
+	fprintf(stderr, "Bad trace header in %s\n", path);
+	tstream_close(s);
+	return NULL;
+    }
+    if (pthread_create(&s->reader, NULL, reader_main, s) != 0) {
+	fprintf(stderr, "Could not start the reader thread for %s\n", path);
+	tstream_close(s);
+	return NULL;
+    }
+    s->started = 1;
+    return s;
+}
+
+/*
+ * tstream_next - give back the chunk the replay was holding and wait
+ *     for the reader to fill the other one
+ */
+int tstream_next(tstream_t *s, traceop_t **ops)
+{
+    int next, n;
+
+    if (s->done)
+	return 0;
+    pthread_mutex_lock(&s->lock);
+    next = 0;
+    if (s->cur >= 0) {
+	s->full[s->cur] = 0;
+	pthread_cond_broadcast(&s->cond);
+	next = s->cur ^ 1;
+    }
+    while (!s->full[next])
+	pthread_cond_wait(&s->cond, &s->lock);
+    s->cur = next;
+    n = s->len[next];
+    pthread_mutex_unlock(&s->lock);
+
+    if (n <= 0)
+	s->done = 1;
+    if (n < 0)
+	fprintf(stderr, "%s: %s\n", s->path, s->err);
+    *ops = s->buf[next];
+    return n;
+}
+
+/*
+ * tstream_header - the header fields of the trace
+ */
+void tstream_header(tstream_t *s, int *sugg_heapsize, int *num_ids,
+		    long long *num_ops, int *weight)
+{
+    *sugg_heapsize = s->sugg_heapsize;
+    *num_ids = s->num_ids;
+    *num_ops = s->num_ops;
+    *weight = s->weight;
+}
+
+/*
+ * tstream_close - stop the reader thread and free everything. Also
+ *     cleans up after a partly opened stream.
+ */
+void tstream_close(tstream_t *s)
+{
+    if (s->started) {
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->reader, NULL);
+    }
+    if (s->fp != NULL)
+	fclose(s->fp);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->buf[0]);
+    free(s->buf[1]);
+    free(s->iobuf);
+    free(s->zbuf);
+    free(s->path);
+    free(s);
+}
@@ -0,0 +1,23 @@
+/*
+ * Streaming trace reader
+ */
+#include "trace.h"
+
+typedef struct tstream tstream_t;
+
+/* Open a text, binary, or compressed trace and start reading it on a
+   thread of its own. Return NULL, after printing why on stderr, if it
+   cannot be opened or its header is bad */
+tstream_t *tstream_open(char *path);
+
+/* Point *ops at the next chunk of ops and return how many it holds,
+   0 at the end of the trace, or -1, after printing why on stderr, if
+   the trace is malformed. The chunk stays valid until the next call */
+int tstream_next(tstream_t *s, traceop_t **ops);
+
+/* The header fields of the trace */
+void tstream_header(tstream_t *s, int *sugg_heapsize, int *num_ids,
+		    long long *num_ops, int *weight);
+
+/* Stop the reader thread and close the trace */
+void tstream_close(tstream_t *s);
@@ -0,0 +1,235 @@
+/*
+ * ztrace.c - Encode and decode the ops of a compressed trace.
+ *
+ * Each op starts with a tag byte. Its low two bits are the op type
+ * (ALLOC, FREE, or REALLOC); the other six hold short codes for the id
+ * and the size, so that most ops take one or two bytes. Ids are coded
+ * by their age, next_id - 1 - id, which is small for blocks that die
+ * young, or by their distance from the id of the last op of the same
+ * type, which is small for blocks freed or resized in a stride. Sizes
+ * are coded by their place among the last three sizes used:
+ *
+ *   FREE             bits 2-7  id code: 0 = the id of the last op,
+ *                              1..30 = age 0..29, 31..62 = the id of
+ *                              the last FREE -16..-1, +1..+16,
+ *                              63 = varint follows
+ *   ALLOC, REALLOC   bits 2-5  id code: 0 = next_id (ALLOC) or the id
+ *                              of the last op (REALLOC), 1..12 = age
+ *                              0..11, 13..14 = the id of the last op of
+ *                              the same type +0, +1, 15 = varint follows
+ *                    bits 6-7  size code: 0..2 = sizes[k], 3 = varint
+ *                              follows
+ *
+ * A varint is 7 bits per byte, low bits first, with the top bit set
+ * on all but the last byte. An escaped id is its age, zigzag coded in
+ * case the id is beyond next_id. The id varint comes before the size
+ * varint. Every byte boundary is an op boundary, so the ops can be
+ * decoded a buffer at a time without any bit reader.
+ */
+#include "ztrace.h"
+
+#define FREE_AGES  30    /* FREE id codes 1..FREE_AGES are ages */
+#define FREE_DELTA 16    /* ... the next 2*FREE_DELTA are strides */
+#define FREE_ESC   63    /* id code of a FREE with a varint id */
+#define ID_AGES    12    /* ALLOC and REALLOC id codes 1..ID_AGES are ages */
+#define ID_SAME    13    /* ... ID_SAME and ID_SAME+1 are strides 0, 1 */
+#define ID_ESC     15    /* id code of an ALLOC or REALLOC with a varint */
+#define SIZE_ESC   3     /* size code of a varint size */
+
+/*
+ * put_varint - store v at buf and return the number of bytes used
+ */
+static int put_varint(unsigned char *buf, unsigned v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+	buf[n++] = (unsigned char)(v | 0x80);
+	v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    return n;
+}
+
+/*
+ * get_varint - read a varint at *p into *v and advance *p. Return 0,
+ *     1 if it runs past end, or -1 if it does not fit 32 bits.
+ */
+static int get_varint(const unsigned char **p, const unsigned char *end,
+		      unsigned *v)
+{
+    const unsigned char *q = *p;
+    unsigned x = 0;
+    int shift;
+
+    for (shift = 0; shift < 35; shift += 7) {
+	if (q == end)
+	    return 1;
+	x |= (unsigned)(*q & 0x7f) << shift;
+	if (!(*q++ & 0x80)) {
+	    if (shift == 28 && (q[-1] & 0x70))
+		return -1;
+	    *p = q;
+	    *v = x;
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+/* Zigzag coding folds signed ages onto 0, 1, 2, ... */
+#define ZIGZAG(x)   ((x) < 0 ? ~((unsigned)(x) << 1) : (unsigned)(x) << 1)
+#define UNZIGZAG(u) ((u) & 1 ? -(long long)((u) >> 1) - 1 : (long long)((u) >> 1))
+
+/*
+ * use_size - move size to the front of the recent sizes
+ */
+static void use_size(ztrace_ctx_t *z, int k, int size)
+{
+    for (; k > 0; k--)
+	z->sizes[k] = z->sizes[k-1];
+    z->sizes[0] = size;
+}
+
+/*
+ * ztrace_init - forget every op seen so far
+ */
+void ztrace_init(ztrace_ctx_t *z)
+{
+    z->next_id = 0;
+    z->last_id = -1;
+    z->last_of[ALLOC] = z->last_of[FREE] = z->last_of[REALLOC] = -1;
+    z->sizes[0] = z->sizes[1] = z->sizes[2] = 0;
+}
+
+/*
+ * ztrace_encode - encode one op into buf
+ */
+int ztrace_encode(ztrace_ctx_t *z, traceop_t *op, unsigned char *buf)
+{
+    long long age = (long long)z->next_id - 1 - op->index;
+    long long delta = (long long)op->index - z->last_of[op->type];
+    int n = 1, idcode, k = 0;
+
+    if (op->type == FREE) {
+	if (op->index == z->last_id)
+	    idcode = 0;
+	else if (age >= 0 && age < FREE_AGES)
+	    idcode = age + 1;
+	else if (delta >= -FREE_DELTA && delta <= FREE_DELTA && delta != 0)
+	    idcode = FREE_AGES + 1 + (int)delta + FREE_DELTA - (delta > 0);
+	else
+	    idcode = FREE_ESC;
+	buf[0] = FREE | idcode << 2;
+    }
+    else {
+	if (op->type == ALLOC ? op->index == z->next_id :
+	    op->index == z->last_id)
+	    idcode = 0;
+	else if (age >= 0 && age < ID_AGES)
+	    idcode = age + 1;
+	else if (delta == 0 || delta == 1)
+	    idcode = ID_SAME + (int)delta;
+	else
+	    idcode = ID_ESC;
+	for (k = 0; k < SIZE_ESC && z->sizes[k] != op->size; k++)
+	    ;
+	buf[0] = op->type | idcode << 2 | k << 6;
+    }
+    if (idcode == (op->type == FREE ? FREE_ESC : ID_ESC))
+	n += put_varint(buf + n, ZIGZAG(age));
+
+    if (op->type != FREE) {
+	if (k == SIZE_ESC) {
+	    n += put_varint(buf + n, op->size);
+	    k = SIZE_ESC - 1;
+	}
+	use_size(z, k, op->size);
+    }
+    if (op->index >= z->next_id)
+	z->next_id = op->index + 1;
+    z->last_id = op->index;
+    z->last_of[op->type] = op->index;
+    return n;
+}
+
+/*
+ * ztrace_decode - decode ops until max of them are done, the bytes run
+ *     out, or a bad one turns up
+ */
+int ztrace_decode(ztrace_ctx_t *z, const unsigned char **p,
+		  const unsigned char *end, traceop_t *ops, int max)
+{
+    const unsigned char *q;
+    unsigned tag, v;
+    long long id;
+    int i, k, size, r, d;
+
+    for (i = 0; i < max; i++) {
+	q = *p;
+	if (q == end)
+	    break;
+	tag = *q++;
+	size = 0;
+
+	switch (tag & 3) {
+	case FREE:
+	    if ((tag >> 2) == 0)
+		id = z->last_id;
+	    else if ((tag >> 2) <= FREE_AGES)
+		id = (long long)z->next_id - (tag >> 2);
+	    else if ((tag >> 2) < FREE_ESC) {
+		d = (int)(tag >> 2) - FREE_AGES - 1 - FREE_DELTA;
+		id = (long long)z->last_of[FREE] + d + (d >= 0);
+	    }
+	    else {
+		if ((r = get_varint(&q, end, &v)) != 0)
+		    return (r > 0) ? i : -1;
+		id = (long long)z->next_id - 1 - UNZIGZAG(v);
+	    }
+	    break;
+
+	case ALLOC:
+	case REALLOC:
+	    k = (tag >> 2) & 15;
+	    if (k == 0)
+		id = ((tag & 3) == ALLOC) ? z->next_id : z->last_id;
+	    else if (k <= ID_AGES)
+		id = (long long)z->next_id - k;
+	    else if (k < ID_ESC)
+		id = (long long)z->last_of[tag & 3] + k - ID_SAME;
+	    else {
+		if ((r = get_varint(&q, end, &v)) != 0)
+		    return (r > 0) ? i : -1;
+		id = (long long)z->next_id - 1 - UNZIGZAG(v);
+	    }
+	    if ((k = tag >> 6) < SIZE_ESC)
+		size = z->sizes[k];
+	    else {
+		if ((r = get_varint(&q, end, &v)) != 0)
+		    return (r > 0) ? i : -1;
+		if (v > 0x7fffffff)
+		    return -1;
+		size = (int)v;
+		k = SIZE_ESC - 1;
+	    }
+	    use_size(z, k, size);
+	    break;
+
+	default:
+	    return -1;
+	}
+	if (id < 0 || id > 0x7fffffff)
+	    return -1;
+
+	ops[i].type = tag & 3;
+	ops[i].index = (int)id;
+	ops[i].size = size;
+	if (id >= z->next_id)
+	    z->next_id = (int)id + 1;
+	z->last_id = (int)id;
+	z->last_of[tag & 3] = (int)id;
+	*p = q;
+    }
+    return i;
+}
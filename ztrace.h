@@ -0,0 +1,42 @@
+/*
+ * Compressed trace format
+ */
+#include "trace.h"
+
+/* Compressed trace files start with this magic number (reads as "MMZT") */
+#define ZTRACE_MAGIC   0x545a4d4d
+#define ZTRACE_VERSION 2
+
+#define ZTRACE_MAXOP   11 /* most bytes one encoded op can take */
+
+/* Header of a compressed trace file, followed by the encoded ops */
+typedef struct {
+    unsigned magic;      /* ZTRACE_MAGIC */
+    unsigned version;    /* ZTRACE_VERSION */
+    int sugg_heapsize;   /* same four fields as the text header, */
+    int num_ids;         /* except that num_ops may exceed an int */
+    long long num_ops;
+    int weight;
+    int pad;
+} ztrace_hdr_t;
+
+/* What the encoder and the decoder know about the ops so far */
+typedef struct {
+    int next_id;         /* one more than the largest id so far */
+    int last_id;         /* id of the last op */
+    int last_of[3];      /* id of the last op of each type */
+    int sizes[3];        /* recent alloc and realloc sizes, newest first */
+} ztrace_ctx_t;
+
+/* Start encoding or decoding a trace from its first op */
+void ztrace_init(ztrace_ctx_t *z);
+
+/* Encode op into buf. Return the number of bytes used */
+int ztrace_encode(ztrace_ctx_t *z, traceop_t *op, unsigned char *buf);
+
+/* Decode up to max ops from the bytes at *p, which end at end, into
+   ops[]. Return how many were decoded, or -1 if a bad op was found.
+   *p is left at the first op that was not decoded, which is cut short
+   if fewer than ZTRACE_MAXOP bytes are left */
+int ztrace_decode(ztrace_ctx_t *z, const unsigned char **p,
+		  const unsigned char *end, traceop_t *ops, int max);